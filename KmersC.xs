@@ -31,54 +31,112 @@ Kmers::get_motif_len()
 
 
 int
-Kmers::open_data(char  * file)
+Kmers::open_data(char  * file, char *residency = NULL)
+
+double
+Kmers::get_warmup_time()
+
+long
+Kmers::get_page_size()
+
+int
+Kmers::get_share_count()
+
+int
+Kmers::get_replica_count()
+
+void
+Kmers::set_max_mapped_shards(int max)
+
+int
+Kmers::open_delta(char *file)
+
+int
+Kmers::reload(char *file)
+
+int
+Kmers::wait_reload()
+
+int
+Kmers::set_search_method(char *method)
+
+const char *
+Kmers::get_search_method()
 
 int
 Kmers::find_all_hits(char *seq, int length(seq), AV *list)
 	CODE:
 	{
-	    char *s = seq;
-	    
 	    size_t slen = XSauto_length_of_seq;
-	    if (slen < THIS->get_motif_len())
-	        return;
-	    
-	    //printf(stderr, "seq len=%d\n", slen); 
+	    int mlen = THIS->get_motif_len();
 
-	    for (int i = 0; i <= slen - THIS->get_motif_len(); i++)
+	    std::vector<motif_hit> hits;
+	    RETVAL = THIS->scan(seq, slen, hits);
+
+	    std::vector<int> attrs;
+	    for (std::vector<motif_hit>::iterator it = hits.begin(); it != hits.end(); it++)
 	    {
-		char *s = seq + i;
-		// fprintf(stderr, "find : i=%d\n", i);
-		std::vector<int> attrs;
-		int n = THIS->find_hit(s, attrs);
-		if (n >= 0)
+		THIS->get_attrs(it->shard, it->n, attrs);
+
+		/*
+		 * Turn the attrs into a list and push to the result list.
+		 */
+		AV *av = newAV();
+		av_push(av, newSViv(it->offset));
+		av_push(av, newSVpvn(seq + it->offset, mlen));
+		for (int ai = 0; ai < attrs.size(); ai++)
 		{
-#if 0
-		    char motif[12];
-		    strncpy(motif, hit->motif, MOTIF_LEN);
-		    motif[MOTIF_LEN] = 0;
-		    char smotif[12];
-		    strncpy(smotif, s, MOTIF_LEN);
-		    smotif[MOTIF_LEN] = 0;
-		    
-		    printf("Hit q=%s t=%s: ff=%d sim=%d i=%d off=%d\n", smotif, motif, hit->ff_value, hit->sim_value, i, offset);
-#endif
-		    //printf("Have hit i=%d n=%d asize=%d\n", i, n, attrs.size());
-		    /*
-		     * Turn the attrs into a list and push to the result list.
-		     */
-		    SV *vals;
-		    AV *av = newAV();
-		    av_push(av, newSViv(i));
-		    av_push(av, newSVpvn(s, THIS->get_motif_len()));
-		    for (int ai = 0; ai < attrs.size(); ai++)
-		    {
-			av_push(av, newSViv(attrs[ai]));
-		    }
-		    av_push(list, (SV *) newRV((SV *) av));
-		    SvREFCNT_dec(av);
+		    av_push(av, newSViv(attrs[ai]));
 		}
-		s++;
+		av_push(list, (SV *) newRV((SV *) av));
+		SvREFCNT_dec(av);
+	    }
+	}
+OUTPUT:
+	RETVAL
+
+int
+Kmers::find_motif_hits(AV *motifs, AV *list)
+	CODE:
+	{
+	    int count = av_len(motifs) + 1;
+	    int mlen = THIS->get_motif_len();
+	    std::vector<char *> mptrs(count);
+	    std::vector<long> results(count);
+	    std::vector<int> shards(count);
+
+	    for (int i = 0; i < count; i++)
+	    {
+		SV **elem = av_fetch(motifs, i, 0);
+		STRLEN len;
+
+		if (!elem || !*elem)
+		    croak("find_motif_hits: missing motif %d", i);
+		mptrs[i] = SvPV(*elem, len);
+		if (len < mlen)
+		    croak("find_motif_hits: motif %d is shorter than %d", i, mlen);
+	    }
+
+	    THIS->find_hits(count ? &mptrs[0] : 0, count, count ? &results[0] : 0, count ? &shards[0] : 0);
+
+	    RETVAL = 0;
+	    std::vector<int> attrs;
+	    for (int i = 0; i < count; i++)
+	    {
+		if (results[i] < 0)
+		    continue;
+		THIS->get_attrs(shards[i], results[i], attrs);
+
+		AV *av = newAV();
+		av_push(av, newSViv(i));
+		av_push(av, newSVpvn(mptrs[i], mlen));
+		for (int ai = 0; ai < attrs.size(); ai++)
+		{
+		    av_push(av, newSViv(attrs[ai]));
+		}
+		av_push(list, (SV *) newRV((SV *) av));
+		SvREFCNT_dec(av);
+		RETVAL++;
 	    }
 	}
 OUTPUT:
@@ -108,6 +166,51 @@ KmersFileCreator::new(int magic, int motif_len, int pad_len, AV * attr_len_list)
 	OUTPUT:
 	RETVAL
 
+int
+KmersFileCreator::set_packed_keys(int on)
+
+int
+KmersFileCreator::set_eytzinger_index(int on)
+
+int
+KmersFileCreator::set_stree_index(int on)
+
+int
+KmersFileCreator::set_bloom_filter(double fpr)
+
+int
+KmersFileCreator::set_mphf_index(int on)
+
+int
+KmersFileCreator::set_cuckoo_table(int on)
+
+int
+KmersFileCreator::set_pgm_index(int on)
+
+int
+KmersFileCreator::set_format_version(int version)
+
+int
+KmersFileCreator::set_columnar_attrs(int on)
+
+int
+KmersFileCreator::set_bitpacked_attrs(int on)
+
+int
+KmersFileCreator::set_dictionary_attrs(int on)
+
+int
+KmersFileCreator::set_front_coded_keys(int on)
+
+int
+KmersFileCreator::set_elias_fano_keys(int on)
+
+int
+KmersFileCreator::set_delta_table(int on)
+
+int
+KmersFileCreator::write_tombstone(char *motif)
+
 int
 KmersFileCreator::write_file_header()
 
@@ -138,3 +241,87 @@ KmersFileCreator::write_entry(char *motif, AV *values)
 	}
 	OUTPUT: RETVAL
 	    
+int
+compact_table(char *base, char *delta, char *output)
+	CODE:
+	{
+	    RETVAL = compact_table(base, delta, output, 0, 0);
+	}
+OUTPUT:
+	RETVAL
+
+
+MODULE = KmersC PACKAGE = KmersMulti
+
+KmersMulti *
+KmersMulti::new()
+	CODE:
+
+	RETVAL = new KmersMulti();
+
+	OUTPUT:
+	RETVAL
+
+void
+KmersMulti::DESTROY()
+
+int
+KmersMulti::open_data(char *file, char *residency = NULL)
+
+double
+KmersMulti::get_warmup_time()
+
+long
+KmersMulti::get_page_size()
+
+int
+KmersMulti::num_tables()
+
+int
+KmersMulti::find_all_hits(char *seq, int length(seq), AV *list)
+	CODE:
+	{
+	    size_t slen = XSauto_length_of_seq;
+
+	    std::vector<multik_hit> hits;
+	    RETVAL = THIS->scan(seq, slen, hits);
+
+	    std::vector<int> attrs;
+	    for (std::vector<multik_hit>::iterator it = hits.begin(); it != hits.end(); it++)
+	    {
+		THIS->get_attrs(it->table, it->n, attrs);
+
+		AV *av = newAV();
+		av_push(av, newSViv(it->offset));
+		av_push(av, newSViv(it->k));
+		av_push(av, newSVpvn(seq + it->offset, it->k));
+		for (int ai = 0; ai < attrs.size(); ai++)
+		{
+		    av_push(av, newSViv(attrs[ai]));
+		}
+		av_push(list, (SV *) newRV((SV *) av));
+		SvREFCNT_dec(av);
+	    }
+	}
+OUTPUT:
+	RETVAL
+
+int
+write_file(char *file, AV *tables)
+	CODE:
+	{
+	    int count = av_len(tables) + 1;
+	    std::vector<char *> names(count);
+
+	    for (int i = 0; i < count; i++)
+	    {
+		SV **elem = av_fetch(tables, i, 0);
+
+		if (!elem || !*elem)
+		    croak("write_file: missing table %d", i);
+		names[i] = SvPV_nolen(*elem);
+	    }
+	    RETVAL = write_multik_file(file, count ? &names[0] : 0, count);
+	}
+OUTPUT:
+	RETVAL
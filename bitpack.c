@@ -0,0 +1,62 @@
+
+#include "bitpack.h"
+#include <stdlib.h>
+
+int bitpack_build(const int32_t *values, uint64_t count, int32_t min, int32_t max,
+		  void **data, size_t *size)
+{
+    uint32_t range = (uint32_t) ((int64_t) max - min);
+    int bits = 0;
+    while (bits < 32 && (range >> bits) != 0)
+	bits++;
+
+    size_t sz = sizeof(struct bitpack_header) + (count * bits + 7) / 8 + sizeof(uint64_t);
+    char *buf = (char *) calloc(sz, 1);
+    if (buf == 0)
+    {
+	fprintf(stderr, "bitpack_build: cannot allocate %zu bytes\n", sz);
+	return 0;
+    }
+
+    struct bitpack_header *hdr = (struct bitpack_header *) buf;
+    hdr->count = count;
+    hdr->base = min;
+    hdr->bits = bits;
+
+    unsigned char *out = (unsigned char *) buf + sizeof(*hdr);
+    uint64_t n;
+    for (n = 0; n < count; n++)
+    {
+	uint64_t v = (uint32_t) ((int64_t) values[n] - min);
+	uint64_t bit = n * bits;
+	unsigned char *p = out + bit / 8;
+	v <<= bit % 8;
+	while (v)
+	{
+	    *p++ |= v & 0xff;
+	    v >>= 8;
+	}
+    }
+
+    *data = buf;
+    *size = sz;
+    return 1;
+}
+
+int bitpack_load(struct bitpack_column *col, const void *data, size_t size)
+{
+    const struct bitpack_header *hdr = (const struct bitpack_header *) data;
+    if (size < sizeof(*hdr) || hdr->bits > 32 ||
+	size != sizeof(*hdr) + (hdr->count * hdr->bits + 7) / 8 + sizeof(uint64_t))
+    {
+	fprintf(stderr, "bitpack_load: column has invalid header\n");
+	return 0;
+    }
+
+    col->count = hdr->count;
+    col->base = hdr->base;
+    col->bits = hdr->bits;
+    col->mask = ((uint64_t) 1 << hdr->bits) - 1;
+    col->data = (const unsigned char *) data + sizeof(*hdr);
+    return 1;
+}
@@ -0,0 +1,65 @@
+#ifndef _bitpack_h
+#define _bitpack_h
+
+/*
+ * Bit-packed, frame-of-reference attribute columns.
+ *
+ * A column of integer values is stored as the column's minimum (the
+ * base) plus each value's offset from it in just enough bits for the
+ * largest offset. An attribute whose values span a range of 2^17 then
+ * takes 17 bits per entry instead of 4 bytes, and a column holding a
+ * single value takes none.
+ *
+ * The serialized column is a bitpack_header followed by the packed
+ * offsets, least significant bit first, and 8 bytes of zero padding so
+ * that any value can be read with one unaligned 64-bit load. Offsets
+ * take up to 32 bits, as a column may span the whole int32 range.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <endian.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bitpack_header
+{
+    uint64_t count;
+    int32_t base;
+    uint32_t bits;
+    uint64_t reserved[6];
+};
+
+struct bitpack_column
+{
+    uint64_t count;
+    int32_t base;
+    int bits;
+    uint64_t mask;
+    const unsigned char *data;
+};
+
+/*
+ * Pack count values, all within [min, max].
+ */
+int bitpack_build(const int32_t *values, uint64_t count, int32_t min, int32_t max,
+		  void **data, size_t *size);
+int bitpack_load(struct bitpack_column *col, const void *data, size_t size);
+
+inline int32_t bitpack_get(const struct bitpack_column *col, uint64_t n)
+{
+    uint64_t bit = n * col->bits;
+    uint64_t word;
+    memcpy(&word, col->data + bit / 8, sizeof(word));
+    return (int32_t) ((int64_t) col->base + (int64_t) ((le64toh(word) >> (bit % 8)) & col->mask));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _bitpack_h */
@@ -0,0 +1,115 @@
+
+#include "bloom.h"
+#include "hash.h"
+#include "table.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * Bit positions within a block take 9 bits each of a rehash of the
+ * key's hash, 7 to a rehash.
+ */
+#define BITS_PER_POSITION 9
+
+static void set_bits(uint64_t *block, uint64_t h, int nhashes)
+{
+    uint64_t bits = 0;
+    int i;
+    for (i = 0; i < nhashes; i++)
+    {
+	if (i % 7 == 0)
+	    bits = hash_seed(h, i / 7 + 1);
+	unsigned int b = bits & 511;
+	bits >>= BITS_PER_POSITION;
+	block[b >> 6] |= (uint64_t) 1 << (b & 63);
+    }
+}
+
+int bloom_contains(const struct bloom_filter *bf, uint64_t h)
+{
+    const uint64_t *block = bloom_block(bf, h);
+    uint64_t bits = 0;
+    int i;
+    for (i = 0; i < bf->nhashes; i++)
+    {
+	if (i % 7 == 0)
+	    bits = hash_seed(h, i / 7 + 1);
+	unsigned int b = bits & 511;
+	bits >>= BITS_PER_POSITION;
+	if (!(block[b >> 6] & ((uint64_t) 1 << (b & 63))))
+	    return 0;
+    }
+    return 1;
+}
+
+int bloom_build(struct motif_table *tbl, double fpr, void **data, size_t *size)
+{
+    if (fpr <= 0 || fpr >= 1)
+    {
+	fprintf(stderr, "bloom_build: false positive rate %g out of range\n", fpr);
+	return 0;
+    }
+
+    /*
+     * The classic sizing is 1.44 log2(1/fpr) bits per key; blocking
+     * costs roughly another 15% plus half a bit to hold the same rate.
+     */
+    double lg = log2(1.0 / fpr);
+    double bits_per_key = 1.44 * lg * 1.15 + 0.5;
+    int nhashes = (int) (lg + 0.5);
+    if (nhashes < 1)
+	nhashes = 1;
+    if (nhashes > 16)
+	nhashes = 16;
+
+    uint64_t nblocks = (uint64_t) ceil(tbl->len * bits_per_key / (64 * BLOOM_BLOCK_WORDS));
+    if (nblocks == 0)
+	nblocks = 1;
+
+    size_t sz = sizeof(struct bloom_header) + nblocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+    char *buf = (char *) calloc(sz, 1);
+    if (buf == 0)
+    {
+	fprintf(stderr, "bloom_build: cannot allocate %zu bytes\n", sz);
+	return 0;
+    }
+
+    struct bloom_header *hdr = (struct bloom_header *) buf;
+    hdr->nblocks = nblocks;
+    hdr->nhashes = nhashes;
+    hdr->fpr = fpr;
+
+    struct bloom_filter bf;
+    bf.nblocks = nblocks;
+    bf.nhashes = nhashes;
+    bf.blocks = (const uint64_t *) (buf + sizeof(*hdr));
+
+    unsigned long n;
+    for (n = 0; n < tbl->len; n++)
+    {
+	uint64_t h = entry_hash(tbl, n);
+	set_bits((uint64_t *) bloom_block(&bf, h), h, nhashes);
+    }
+
+    *data = buf;
+    *size = sz;
+    return 1;
+}
+
+int bloom_load(struct bloom_filter *bf, const void *data, size_t size)
+{
+    const struct bloom_header *hdr = (const struct bloom_header *) data;
+    if (size < sizeof(*hdr) ||
+	size != sizeof(*hdr) + hdr->nblocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t) ||
+	hdr->nhashes < 1 || hdr->nhashes > 16)
+    {
+	fprintf(stderr, "bloom_load: filter has invalid size %zu\n", size);
+	return 0;
+    }
+
+    bf->nblocks = hdr->nblocks;
+    bf->nhashes = hdr->nhashes;
+    bf->blocks = (const uint64_t *) ((const char *) data + sizeof(*hdr));
+    return 1;
+}
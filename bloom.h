@@ -0,0 +1,67 @@
+#ifndef _bloom_h
+#define _bloom_h
+
+/*
+ * Cache-line blocked Bloom filter over the keys of a table.
+ *
+ * A key's hash picks one 512-bit block, and all of the key's bits are
+ * set within that block, so a lookup costs a single cache line. This
+ * is a little less accurate than a classic Bloom filter of the same
+ * size; bloom_build adds bits per key to make up for it.
+ *
+ * The serialized filter is a bloom_header followed by the blocks.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLOOM_MAGIC 0x424c4f4d	/* "BLOM" */
+#define BLOOM_SUFFIX ".bloom"
+
+#define BLOOM_BLOCK_WORDS 8
+
+struct motif_table;
+
+struct bloom_header
+{
+    uint64_t nblocks;
+    uint32_t nhashes;
+    uint32_t reserved0;
+    double fpr;
+    uint64_t reserved[5];
+};
+
+struct bloom_filter
+{
+    uint64_t nblocks;
+    int nhashes;
+    const uint64_t *blocks;
+};
+
+/*
+ * Build a filter over the keys of tbl for the given false positive rate.
+ */
+int bloom_build(struct motif_table *tbl, double fpr, void **data, size_t *size);
+int bloom_load(struct bloom_filter *bf, const void *data, size_t size);
+
+inline const uint64_t *bloom_block(const struct bloom_filter *bf, uint64_t h)
+{
+    return bf->blocks + BLOOM_BLOCK_WORDS * (((unsigned __int128) h * bf->nblocks) >> 64);
+}
+
+/*
+ * Return 0 if the key with hash h (see hash.h) is certainly not in the
+ * table.
+ */
+int bloom_contains(const struct bloom_filter *bf, uint64_t h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _bloom_h */
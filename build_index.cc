@@ -0,0 +1,174 @@
+/*
+ * Build search index sidecars for an existing table file, for tables
+ * that were written without them.
+ *
+ * This program takes command arguments as follows:
+ *
+ *    Table file.
+ *
+ *    One or more indexes to build:
+ *
+ *       eytzinger    Eytzinger search index (packed-key tables only)
+ *       stree        S-tree search index (packed-key tables only)
+ *       mphf         minimal perfect hash index
+ *       pgm          learned index (packed-key tables only)
+ *       bloom=FPR    Bloom filter with false positive rate FPR
+ *
+ * For a version 1 table each index is written next to the table as the
+ * table file name plus the index's suffix. A version 2 table gets them
+ * as new sections of the table file instead: the table is copied to the
+ * file name plus .tmp, the sections are added to the copy, and the copy
+ * is renamed over the table, so processes that have the table mapped
+ * keep reading the old file.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "table.h"
+
+typedef int (*build_fn)(struct motif_table *, void **, size_t *);
+
+/*
+ * The copy of the table and its header, for adding sections to a
+ * version 2 table.
+ */
+static FILE *table_fp;
+static char table_tmp[1100];
+static struct motif_table_header_v2 table_header;
+
+/*
+ * Copy the mapped table to table_tmp, with the table file's mode.
+ */
+static FILE *copy_table(struct motif_table *tbl)
+{
+    FILE *fp = fopen(table_tmp, "w+");
+    if (fp == 0)
+    {
+	perror(table_tmp);
+	return 0;
+    }
+    struct stat s;
+    if (fstat(tbl->mapped_fd, &s) != 0 || fchmod(fileno(fp), s.st_mode & 07777) != 0 ||
+	fwrite(tbl->mapped_address, 1, tbl->mapped_size, fp) != tbl->mapped_size)
+    {
+	perror(table_tmp);
+	fclose(fp);
+	unlink(table_tmp);
+	return 0;
+    }
+    return fp;
+}
+
+static int store(struct motif_table *tbl, const char *suffix, uint32_t magic, void *data, size_t size)
+{
+    int ok;
+    if (tbl->version >= 2)
+    {
+	ok = add_table_section(table_fp, &table_header, magic, data, size);
+	printf("Added %zu byte section to %s\n", size, tbl->mapped_file);
+    }
+    else
+    {
+	ok = write_sidecar(tbl, suffix, magic, data, size);
+	printf("Wrote %zu bytes to %s%s\n", size, tbl->mapped_file, suffix);
+    }
+    free(data);
+    return ok;
+}
+
+static int build(struct motif_table *tbl, const char *name, const char *suffix, uint32_t magic, build_fn fn)
+{
+    void *data;
+    size_t size;
+    printf("Building %s index\n", name);
+    if (!fn(tbl, &data, &size))
+	return 0;
+    return store(tbl, suffix, magic, data, size);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+	fprintf(stderr, "Usage: %s table-file eytzinger|stree|mphf|pgm|bloom=FPR ...\n", argv[0]);
+	exit(1);
+    }
+
+    struct motif_table tbl;
+    memset(&tbl, 0, sizeof(tbl));
+    if (!map_table(argv[1], &tbl))
+	exit(1);
+    if (tbl.header.flags & MOTIF_TABLE_CUCKOO)
+    {
+	fprintf(stderr, "%s is a cuckoo table, which needs no index\n", argv[1]);
+	exit(1);
+    }
+    if (tbl.header.flags & MOTIF_TABLE_ENCODED_KEYS)
+    {
+	fprintf(stderr, "%s has encoded keys, which only support exact lookups\n", argv[1]);
+	exit(1);
+    }
+    if (tbl.version >= 2)
+    {
+	memcpy(&table_header, tbl.mapped_address, sizeof(table_header));
+	snprintf(table_tmp, sizeof(table_tmp), "%s.tmp", argv[1]);
+	table_fp = copy_table(&tbl);
+	if (table_fp == 0)
+	    exit(1);
+    }
+
+    int ok = 1;
+    for (int i = 2; i < argc; i++)
+    {
+	char *arg = argv[i];
+	if (strcmp(arg, "eytzinger") == 0)
+	    ok = build(&tbl, arg, EYTZINGER_SUFFIX, EYTZINGER_MAGIC, eytzinger_build) && ok;
+	else if (strcmp(arg, "stree") == 0)
+	    ok = build(&tbl, arg, STREE_SUFFIX, STREE_MAGIC, stree_build) && ok;
+	else if (strcmp(arg, "mphf") == 0)
+	    ok = build(&tbl, arg, MPHF_SUFFIX, MPHF_MAGIC, mphf_build) && ok;
+	else if (strcmp(arg, "pgm") == 0)
+	    ok = build(&tbl, arg, PGM_SUFFIX, PGM_MAGIC, pgm_build) && ok;
+	else if (strncmp(arg, "bloom=", 6) == 0)
+	{
+	    void *data;
+	    size_t size;
+	    double fpr = atof(arg + 6);
+	    printf("Building bloom filter, fpr=%g\n", fpr);
+	    if (bloom_build(&tbl, fpr, &data, &size))
+		ok = store(&tbl, BLOOM_SUFFIX, BLOOM_MAGIC, data, size) && ok;
+	    else
+		ok = 0;
+	}
+	else
+	{
+	    fprintf(stderr, "Unknown index type %s\n", arg);
+	    ok = 0;
+	}
+    }
+
+    if (table_fp)
+    {
+	int written = fflush(table_fp) == 0 && fsync(fileno(table_fp)) == 0;
+	if (fclose(table_fp) != 0)
+	    written = 0;
+	if (written && ok && rename(table_tmp, argv[1]) != 0)
+	    written = 0;
+	if (!written)
+	{
+	    fprintf(stderr, "Error writing %s: %s\n", argv[1], strerror(errno));
+	    ok = 0;
+	}
+	if (!ok)
+	{
+	    fprintf(stderr, "%s left unchanged\n", argv[1]);
+	    unlink(table_tmp);
+	}
+    }
+    unmap_table(&tbl);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+/*
+ * Merge a delta table into its base table, writing a new table.
+ *
+ * This program takes command arguments as follows:
+ *
+ *    Base table file.
+ *
+ *    Delta table file (see KmersFileCreator::set_delta_table).
+ *
+ *    Output table file.
+ *
+ *    Optionally, indexes to build for the output, as for build_index:
+ *    eytzinger, stree, mphf, pgm, bloom=FPR.
+ *
+ * Both tables are sorted, so they are merged in one pass. An entry in
+ * the delta replaces the base entry for the same motif, and a
+ * tombstone drops it. The output has the base's format version, key
+ * layout and attribute layout (see compact_table in kmers.h).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kmers.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+	fprintf(stderr, "Usage: %s base-table delta-table output-table [eytzinger|stree|mphf|pgm|bloom=FPR ...]\n", argv[0]);
+	exit(1);
+    }
+    return compact_table(argv[1], argv[2], argv[3], argv + 4, argc - 4) ? 0 : 1;
+}
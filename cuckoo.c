@@ -0,0 +1,252 @@
+
+#include "cuckoo.h"
+#include "hash.h"
+#include "table.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Target load factor. Four-way buckets fill to about 97% before
+ * inserts start to fail; leave some room so they rarely do.
+ */
+#define LOAD_FACTOR 0.93
+
+/*
+ * Evictions to try before giving up on an insert and growing the table.
+ */
+#define MAX_KICKS 500
+
+/*
+ * Times to grow the table before giving up. Each round adds 1/16, so
+ * this allows for far worse luck than a well-behaved hash ever has.
+ */
+#define MAX_GROWTH 64
+
+#define EMPTY UINT64_MAX
+
+void cuckoo_buckets(uint64_t h, uint64_t nbuckets, uint64_t b[2])
+{
+    b[0] = hash_range(h, nbuckets);
+    b[1] = hash_range(hash_seed(h, 0x300), nbuckets);
+    if (b[1] == b[0] && nbuckets > 1)
+	b[1] = (b[0] + 1) % nbuckets;
+}
+
+static uint64_t row_hash(const char *row, int motif_len, int flags, int version)
+{
+    if (flags & MOTIF_TABLE_PACKED_KEYS)
+    {
+	uint64_t key;
+	memcpy(&key, row, sizeof(key));
+	return hash_key(version >= 2 ? key : be64toh(key));
+    }
+    return hash_motif(row, motif_len);
+}
+
+static int place_in(uint64_t *slots, uint64_t b, uint64_t r)
+{
+    int s;
+    for (s = 0; s < CUCKOO_SLOTS; s++)
+    {
+	if (slots[b * CUCKOO_SLOTS + s] == EMPTY)
+	{
+	    slots[b * CUCKOO_SLOTS + s] = r;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * Try to place all rows in nbuckets buckets, filling slots with row
+ * numbers. Returns 0 if some row could not be placed.
+ */
+static int insert_all(const uint64_t *hashes, uint64_t count, uint64_t nbuckets, uint64_t *slots)
+{
+    uint64_t rng = 0x2545f4914f6cdd1dULL;
+    uint64_t i;
+
+    for (i = 0; i < nbuckets * CUCKOO_SLOTS; i++)
+	slots[i] = EMPTY;
+
+    for (i = 0; i < count; i++)
+    {
+	uint64_t b[2];
+	cuckoo_buckets(hashes[i], nbuckets, b);
+	if (place_in(slots, b[0], i) || place_in(slots, b[1], i))
+	    continue;
+
+	/*
+	 * Random walk: evict a random occupant of one of our buckets and
+	 * move it to its other bucket, until something lands in a free
+	 * slot.
+	 */
+	uint64_t cur = i;
+	uint64_t at = b[rng & 1];
+	int kick;
+	for (kick = 0; kick < MAX_KICKS; kick++)
+	{
+	    rng ^= rng << 13;
+	    rng ^= rng >> 7;
+	    rng ^= rng << 17;
+	    uint64_t *slot = &slots[at * CUCKOO_SLOTS + (rng >> 32) % CUCKOO_SLOTS];
+	    uint64_t victim = *slot;
+	    *slot = cur;
+	    cur = victim;
+
+	    uint64_t vb[2];
+	    cuckoo_buckets(hashes[cur], nbuckets, vb);
+	    at = vb[0] == at ? vb[1] : vb[0];
+	    if (place_in(slots, at, cur))
+		break;
+	}
+	if (kick == MAX_KICKS)
+	    return 0;
+    }
+    return 1;
+}
+
+struct hashed_row
+{
+    uint64_t hash;
+    uint64_t row;
+};
+
+static int compare_hashed_rows(const void *a, const void *b)
+{
+    uint64_t x = ((const struct hashed_row *) a)->hash;
+    uint64_t y = ((const struct hashed_row *) b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Return 1 if two rows have the same key. Rows with equal keys share
+ * both buckets, so more than 2 * CUCKOO_SLOTS of them can never be
+ * placed, and a lookup would find an arbitrary one of them anyway.
+ */
+static int find_duplicate_key(const uint64_t *hashes, uint64_t count, const char *rows, int entry_len,
+			      int key_len)
+{
+    struct hashed_row *hr = (struct hashed_row *) malloc((count + 1) * sizeof(*hr));
+    if (hr == 0)
+	return 0;
+    uint64_t i, j;
+    for (i = 0; i < count; i++)
+    {
+	hr[i].hash = hashes[i];
+	hr[i].row = i;
+    }
+    qsort(hr, count, sizeof(*hr), compare_hashed_rows);
+    int dup = 0;
+    for (i = 0; i < count && !dup; i++)
+	for (j = i + 1; j < count && hr[j].hash == hr[i].hash && !dup; j++)
+	    dup = memcmp(rows + hr[i].row * entry_len, rows + hr[j].row * entry_len, key_len) == 0;
+    free(hr);
+    return dup;
+}
+
+int cuckoo_write(FILE *fp, const char *rows, uint64_t count, int entry_len,
+		 int motif_len, int flags, int version)
+{
+    uint64_t *hashes = (uint64_t *) malloc((count + 1) * sizeof(uint64_t));
+    if (hashes == 0)
+    {
+	fprintf(stderr, "cuckoo_write: cannot allocate memory for %lu entries\n", (unsigned long) count);
+	return 0;
+    }
+    uint64_t i;
+    for (i = 0; i < count; i++)
+	hashes[i] = row_hash(rows + i * entry_len, motif_len, flags, version);
+
+    int key_len = flags & MOTIF_TABLE_PACKED_KEYS ? (int) sizeof(uint64_t) : motif_len;
+    if (find_duplicate_key(hashes, count, rows, entry_len, key_len))
+    {
+	fprintf(stderr, "cuckoo_write: a motif was written more than once\n");
+	free(hashes);
+	return 0;
+    }
+
+    uint64_t nbuckets = (uint64_t) (count / (CUCKOO_SLOTS * LOAD_FACTOR)) + 1;
+    uint64_t *slots = 0;
+    int round;
+    for (round = 0; ; round++)
+    {
+	if (round == MAX_GROWTH)
+	{
+	    fprintf(stderr, "cuckoo_write: cannot place %lu entries\n", (unsigned long) count);
+	    free(slots);
+	    free(hashes);
+	    return 0;
+	}
+	slots = (uint64_t *) realloc(slots, nbuckets * CUCKOO_SLOTS * sizeof(uint64_t));
+	if (slots == 0)
+	{
+	    fprintf(stderr, "cuckoo_write: cannot allocate %lu buckets\n", (unsigned long) nbuckets);
+	    free(hashes);
+	    return 0;
+	}
+	if (insert_all(hashes, count, nbuckets, slots))
+	    break;
+	nbuckets += nbuckets / 16 + 1;
+    }
+    free(hashes);
+
+    /*
+     * Pad out to the first bucket, then write the buckets.
+     */
+    long pos = ftell(fp);
+    size_t pad = (64 - pos % 64) % 64;
+    char *zero = (char *) calloc(entry_len > 64 ? entry_len : 64, 1);
+    int ok = zero != 0 && pos >= 0;
+    if (ok && pad)
+	ok = fwrite(zero, 1, pad, fp) == pad;
+    for (i = 0; ok && i < nbuckets * CUCKOO_SLOTS; i++)
+    {
+	const char *row = slots[i] == EMPTY ? zero : rows + slots[i] * entry_len;
+	ok = fwrite(row, 1, entry_len, fp) == (size_t) entry_len;
+    }
+    if (!ok)
+	fprintf(stderr, "cuckoo_write: error writing table\n");
+    else
+	fprintf(stderr, "cuckoo_write: %lu entries in %lu buckets (load %.2f)\n",
+		(unsigned long) count, (unsigned long) nbuckets,
+		(double) count / (nbuckets * CUCKOO_SLOTS));
+
+    free(zero);
+    free(slots);
+    return ok;
+}
+
+long cuckoo_find_key(struct motif_table *tbl, uint64_t key)
+{
+    if (key == 0 || tbl->len < CUCKOO_SLOTS)
+	return -1;
+    uint64_t b[2];
+    cuckoo_buckets(hash_key(key), tbl->len / CUCKOO_SLOTS, b);
+    int i, s;
+    for (i = 0; i < 2; i++)
+	for (s = 0; s < CUCKOO_SLOTS; s++)
+	    if (get_key_at(tbl, b[i] * CUCKOO_SLOTS + s) == key)
+		return b[i] * CUCKOO_SLOTS + s;
+    return -1;
+}
+
+long cuckoo_find_motif(struct motif_table *tbl, const char *motif)
+{
+    int mlen = tbl->header.motif_len;
+    if (tbl->len < CUCKOO_SLOTS)
+	return -1;
+    uint64_t b[2];
+    cuckoo_buckets(hash_motif(motif, mlen), tbl->len / CUCKOO_SLOTS, b);
+    int i, s;
+    for (i = 0; i < 2; i++)
+    {
+	for (s = 0; s < CUCKOO_SLOTS; s++)
+	{
+	    const char *row = get_motif_at(tbl, b[i] * CUCKOO_SLOTS + s);
+	    if (row[0] != 0 && strncmp(row, motif, mlen) == 0)
+		return b[i] * CUCKOO_SLOTS + s;
+	}
+    }
+    return -1;
+}
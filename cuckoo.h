@@ -0,0 +1,66 @@
+#ifndef _cuckoo_h
+#define _cuckoo_h
+
+/*
+ * Bucketized cuckoo hash table layout for motif tables.
+ *
+ * A cuckoo table (MOTIF_TABLE_CUCKOO in the header flags) stores its
+ * entries in buckets of CUCKOO_SLOTS rows rather than in sorted order.
+ * Each key hashes to two buckets and sits in one of them, so a lookup
+ * reads at most two buckets. With 16-byte entries a bucket is exactly
+ * one cache line; the buckets start on a cache line boundary after the
+ * file header. Unused slots are zero, which no key encodes to.
+ *
+ * Row n of the table is slot n % CUCKOO_SLOTS of bucket n / CUCKOO_SLOTS,
+ * so entry numbers and attribute access work as for sorted tables.
+ * Since the entries are not sorted, range searches and the sorted-order
+ * indexes do not apply: find_in_range on a cuckoo table always looks in
+ * the key's two buckets and ignores start and len.
+ *
+ * Every motif must be written once; cuckoo_write rejects duplicates.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CUCKOO_SLOTS 4
+
+/*
+ * Entries are padded to this size when they are smaller, so that a
+ * bucket fills a cache line.
+ */
+#define CUCKOO_ENTRY_LEN 16
+
+struct motif_table;
+
+/*
+ * Arrange count rows of entry_len bytes, in any order, into a cuckoo
+ * table and write its buckets to fp, which must be positioned just
+ * after the file header; the buckets start at the next 64-byte
+ * boundary. version is the table format version, which decides the
+ * byte order of packed keys. Returns 0 on error, including when two
+ * rows have the same key.
+ */
+int cuckoo_write(FILE *fp, const char *rows, uint64_t count, int entry_len,
+		 int motif_len, int flags, int version);
+
+/*
+ * The two buckets for hash h (see hash.h).
+ */
+void cuckoo_buckets(uint64_t h, uint64_t nbuckets, uint64_t b[2]);
+
+/*
+ * Look up a packed key or raw motif. Returns the entry number or -1.
+ */
+long cuckoo_find_key(struct motif_table *tbl, uint64_t key);
+long cuckoo_find_motif(struct motif_table *tbl, const char *motif);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _cuckoo_h */
@@ -0,0 +1,168 @@
+
+#include "eliasfano.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline uint64_t get_low(const struct ef_index *ef, uint64_t i)
+{
+    uint64_t bit = i * ef->low_bits;
+    uint64_t w = bit / 64;
+    int off = bit % 64;
+    uint64_t v = ef->low[w] >> off;
+    if (off + ef->low_bits > 64)
+	v |= ef->low[w + 1] << (64 - off);
+    return v & ef->low_mask;
+}
+
+static inline int upper_bit(const struct ef_index *ef, uint64_t p)
+{
+    return (ef->upper[p / 64] >> (p % 64)) & 1;
+}
+
+/*
+ * Position of zero number k (counting from 0) in the upper bits.
+ */
+static uint64_t select_zero(const struct ef_index *ef, uint64_t k)
+{
+    uint64_t p = ef->samples[k / EF_SAMPLE];
+    uint64_t r = k % EF_SAMPLE;
+    uint64_t w = p / 64;
+    uint64_t word = ~ef->upper[w] & (~(uint64_t) 0 << (p % 64));
+    uint64_t c;
+    while ((c = __builtin_popcountll(word)) <= r)
+    {
+	r -= c;
+	word = ~ef->upper[++w];
+    }
+    for (; r; r--)
+	word &= word - 1;
+    return w * 64 + __builtin_ctzll(word);
+}
+
+int ef_build(const uint64_t *keys, uint64_t count, void **data, size_t *size)
+{
+    struct ef_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.count = count;
+
+    uint64_t universe = count ? keys[count - 1] + 1 : 1;
+    int l = 0;
+    while (count && l < 63 && (universe / count) >> (l + 1))
+	l++;
+    hdr.low_bits = l;
+    hdr.nruns = count ? (keys[count - 1] >> l) + 1 : 0;
+
+    uint64_t upper_bits = count + hdr.nruns;
+    hdr.low_words = (count * l + 63) / 64 + 1;
+    hdr.upper_words = (upper_bits + 63) / 64 + 1;
+    hdr.nsamples = (hdr.nruns + EF_SAMPLE - 1) / EF_SAMPLE;
+
+    size_t sz = sizeof(hdr) + (hdr.low_words + hdr.upper_words + hdr.nsamples) * sizeof(uint64_t);
+    char *buf = (char *) calloc(sz, 1);
+    if (buf == 0)
+    {
+	fprintf(stderr, "ef_build: cannot allocate %zu bytes\n", sz);
+	return 0;
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    uint64_t *low = (uint64_t *) (buf + sizeof(hdr));
+    uint64_t *upper = low + hdr.low_words;
+    uint64_t *samples = upper + hdr.upper_words;
+
+    uint64_t mask = l ? (~(uint64_t) 0 >> (64 - l)) : 0;
+    uint64_t i;
+    for (i = 0; i < count; i++)
+    {
+	if (i && keys[i] <= keys[i - 1])
+	{
+	    fprintf(stderr, "ef_build: keys are not strictly increasing at entry %lu\n", (unsigned long) i);
+	    free(buf);
+	    return 0;
+	}
+	uint64_t bit = i * l;
+	uint64_t v = keys[i] & mask;
+	if (l)
+	{
+	    low[bit / 64] |= v << (bit % 64);
+	    if (bit % 64 + l > 64)
+		low[bit / 64 + 1] |= v >> (64 - bit % 64);
+	}
+	uint64_t p = (keys[i] >> l) + i;
+	upper[p / 64] |= (uint64_t) 1 << (p % 64);
+    }
+
+    /*
+     * Sample the position of every EF_SAMPLE-th zero.
+     */
+    uint64_t zeros = 0;
+    uint64_t p;
+    for (p = 0; p < upper_bits; p++)
+    {
+	if (!((upper[p / 64] >> (p % 64)) & 1))
+	{
+	    if (zeros % EF_SAMPLE == 0)
+		samples[zeros / EF_SAMPLE] = p;
+	    zeros++;
+	}
+    }
+
+    *data = buf;
+    *size = sz;
+    return 1;
+}
+
+int ef_load(struct ef_index *ef, const void *data, size_t size)
+{
+    const struct ef_header *hdr = (const struct ef_header *) data;
+    if (size < sizeof(*hdr) || hdr->low_bits > 63 ||
+	hdr->low_words != (hdr->count * hdr->low_bits + 63) / 64 + 1 ||
+	hdr->upper_words != (hdr->count + hdr->nruns + 63) / 64 + 1 ||
+	hdr->nsamples != (hdr->nruns + EF_SAMPLE - 1) / EF_SAMPLE ||
+	size != sizeof(*hdr) + (hdr->low_words + hdr->upper_words + hdr->nsamples) * sizeof(uint64_t))
+    {
+	fprintf(stderr, "ef_load: index has invalid header\n");
+	return 0;
+    }
+
+    ef->count = hdr->count;
+    ef->nruns = hdr->nruns;
+    ef->low_bits = hdr->low_bits;
+    ef->low_mask = hdr->low_bits ? (~(uint64_t) 0 >> (64 - hdr->low_bits)) : 0;
+    ef->low = (const uint64_t *) ((const char *) data + sizeof(*hdr));
+    ef->upper = ef->low + hdr->low_words;
+    ef->samples = ef->upper + hdr->upper_words;
+    return 1;
+}
+
+uint64_t ef_lower_bound(const struct ef_index *ef, uint64_t key, int *found)
+{
+    *found = 0;
+    uint64_t h = key >> ef->low_bits;
+    if (h >= ef->nruns)
+	return ef->count;
+
+    /*
+     * The run for h starts after zero number h - 1; the ones before it
+     * are the keys with smaller high parts.
+     */
+    uint64_t p = h ? select_zero(ef, h - 1) + 1 : 0;
+    uint64_t i = p - h;
+    uint64_t lo = key & ef->low_mask;
+    for (; upper_bit(ef, p); p++, i++)
+    {
+	uint64_t v = get_low(ef, i);
+	if (v >= lo)
+	{
+	    *found = v == lo;
+	    break;
+	}
+    }
+    return i;
+}
+
+long ef_find(const struct ef_index *ef, uint64_t key)
+{
+    int found;
+    uint64_t i = ef_lower_bound(ef, key, &found);
+    return found ? (long) i : -1;
+}
@@ -0,0 +1,76 @@
+#ifndef _eliasfano_h
+#define _eliasfano_h
+
+/*
+ * Elias-Fano encoding of the sorted packed keys of a table.
+ *
+ * Each of the n keys below the universe u is split into its low
+ * l = floor(log2(u / n)) bits, stored packed, and its remaining high
+ * bits, stored in unary in an upper bit vector: key i sets bit
+ * (key >> l) + i, so each run of ones is the keys sharing a high part
+ * and each zero ends a run. That is l + 2 bits per key, close to the
+ * minimum for n sorted keys from u.
+ *
+ * Rank is free: the keys in a run are numbered by the ones before it,
+ * which is the run's position less its high part. The position of a
+ * run is found from samples of every EF_SAMPLE-th zero and a few
+ * popcounts.
+ *
+ * The serialized set is an ef_header followed by the low bits, the
+ * upper bits and the zero samples, all in 64-bit words.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EF_SAMPLE 256
+
+struct ef_header
+{
+    uint64_t count;
+    uint64_t nruns;		/* (largest key >> low_bits) + 1 */
+    uint32_t low_bits;
+    uint32_t reserved0;
+    uint64_t low_words;
+    uint64_t upper_words;
+    uint64_t nsamples;
+    uint64_t reserved[2];
+};
+
+struct ef_index
+{
+    uint64_t count;
+    uint64_t nruns;
+    int low_bits;
+    uint64_t low_mask;
+    const uint64_t *low;
+    const uint64_t *upper;
+    const uint64_t *samples;
+};
+
+/*
+ * Encode count strictly increasing keys.
+ */
+int ef_build(const uint64_t *keys, uint64_t count, void **data, size_t *size);
+int ef_load(struct ef_index *ef, const void *data, size_t size);
+
+/*
+ * The number of keys below key, setting *found if key itself is one.
+ */
+uint64_t ef_lower_bound(const struct ef_index *ef, uint64_t key, int *found);
+
+/*
+ * Return the entry number of key, or -1.
+ */
+long ef_find(const struct ef_index *ef, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _eliasfano_h */
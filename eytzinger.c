@@ -0,0 +1,99 @@
+
+#include "eytzinger.h"
+#include "table.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Walk the implicit tree in order, handing out the sorted table
+ * entries as we go.
+ */
+static void fill(struct motif_table *tbl, uint64_t *keys, uint32_t *entries,
+		 uint64_t count, uint64_t *next, uint64_t k)
+{
+    if (k > count)
+	return;
+    fill(tbl, keys, entries, count, next, 2 * k);
+    keys[k] = get_key_at(tbl, *next);
+    entries[k] = (uint32_t) *next;
+    (*next)++;
+    fill(tbl, keys, entries, count, next, 2 * k + 1);
+}
+
+int eytzinger_build(struct motif_table *tbl, void **data, size_t *size)
+{
+    if (!(tbl->header.flags & MOTIF_TABLE_PACKED_KEYS))
+    {
+	fprintf(stderr, "eytzinger_build: %s does not have packed keys\n", tbl->mapped_file);
+	return 0;
+    }
+    if (is_large_table(tbl))
+    {
+	fprintf(stderr, "eytzinger_build: %s has too many entries\n", tbl->mapped_file);
+	return 0;
+    }
+
+    uint64_t count = tbl->len;
+    size_t sz = sizeof(struct eytzinger_header) +
+	(count + 1) * (sizeof(uint64_t) + sizeof(uint32_t));
+    char *buf = (char *) calloc(sz, 1);
+    if (buf == 0)
+    {
+	fprintf(stderr, "eytzinger_build: cannot allocate %zu bytes\n", sz);
+	return 0;
+    }
+
+    struct eytzinger_header *hdr = (struct eytzinger_header *) buf;
+    hdr->count = count;
+    uint64_t *keys = (uint64_t *) (buf + sizeof(*hdr));
+    uint32_t *entries = (uint32_t *) (keys + count + 1);
+
+    uint64_t next = 0;
+    fill(tbl, keys, entries, count, &next, 1);
+
+    *data = buf;
+    *size = sz;
+    return 1;
+}
+
+int eytzinger_load(struct eytzinger_index *idx, const void *data, size_t size)
+{
+    const struct eytzinger_header *hdr = (const struct eytzinger_header *) data;
+    if (size < sizeof(*hdr) ||
+	size != sizeof(*hdr) + (hdr->count + 1) * (sizeof(uint64_t) + sizeof(uint32_t)))
+    {
+	fprintf(stderr, "eytzinger_load: index has invalid size %zu\n", size);
+	return 0;
+    }
+
+    idx->count = hdr->count;
+    idx->keys = (const uint64_t *) ((const char *) data + sizeof(*hdr));
+    idx->entries = (const uint32_t *) (idx->keys + idx->count + 1);
+    return 1;
+}
+
+long eytzinger_find(const struct eytzinger_index *idx, uint64_t key)
+{
+    const uint64_t *keys = idx->keys;
+    uint64_t n = idx->count;
+    uint64_t k = 1;
+
+    while (k <= n)
+    {
+	/*
+	 * The 8 descendants of k three levels down are keys[8k .. 8k+7],
+	 * one cache line.
+	 */
+	__builtin_prefetch(keys + 8 * k);
+	k = 2 * k + (keys[k] < key);
+    }
+
+    /*
+     * k has walked off the tree; strip the trailing right turns (and the
+     * final left turn) to get back to the lower bound of key.
+     */
+    k >>= __builtin_ffsll(~k);
+    if (k == 0 || keys[k] != key)
+	return -1;
+    return idx->entries[k];
+}
@@ -0,0 +1,61 @@
+#ifndef _eytzinger_h
+#define _eytzinger_h
+
+/*
+ * Eytzinger (BFS order) search index over the packed keys of a table.
+ *
+ * keys[1..count] hold the table's keys laid out as an implicit binary
+ * tree: the children of node k are 2k and 2k+1. A search touches one
+ * node per level, and since the descendants of a node three levels down
+ * share a cache line we can prefetch them well before we need them.
+ * entries[k] is the entry number in the table of keys[k].
+ *
+ * The serialized index is an eytzinger_header followed by the keys
+ * array and the entries array, each count + 1 long. The header is 64
+ * bytes so that the keys start on a cache line.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EYTZINGER_MAGIC 0x45595a54	/* "EYTZ" */
+#define EYTZINGER_SUFFIX ".eytz"
+
+struct motif_table;
+
+struct eytzinger_header
+{
+    uint64_t count;
+    uint64_t reserved[7];
+};
+
+struct eytzinger_index
+{
+    uint64_t count;
+    const uint64_t *keys;
+    const uint32_t *entries;
+};
+
+/*
+ * Build the index for a packed-key table into a malloced buffer.
+ * Returns 0 if the table cannot be indexed.
+ */
+int eytzinger_build(struct motif_table *tbl, void **data, size_t *size);
+
+int eytzinger_load(struct eytzinger_index *idx, const void *data, size_t size);
+
+/*
+ * Return the entry number holding key, or -1.
+ */
+long eytzinger_find(const struct eytzinger_index *idx, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _eytzinger_h */
@@ -0,0 +1,150 @@
+
+#include "frontcode.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ROUND8(x) (((x) + 7) & ~(size_t) 7)
+
+static int shared_prefix(const unsigned char *a, const unsigned char *b, int len)
+{
+    int i = 0;
+    while (i < len && a[i] == b[i])
+	i++;
+    return i;
+}
+
+int frontcode_build(const unsigned char *keys, uint64_t count, int key_len, int block_len,
+		    void **data, size_t *size)
+{
+    if (key_len < 1 || key_len > FRONTCODE_MAX_KEY || block_len < 1)
+    {
+	fprintf(stderr, "frontcode_build: cannot code %d byte keys in blocks of %d\n", key_len, block_len);
+	return 0;
+    }
+
+    uint64_t nblocks = (count + block_len - 1) / block_len;
+    uint64_t n;
+    size_t data_size = 0;
+    for (n = 0; n < count; n++)
+	if (n % block_len)
+	    data_size += 1 + key_len - shared_prefix(keys + (n - 1) * key_len, keys + n * key_len, key_len);
+
+    size_t keys_size = ROUND8(nblocks * key_len);
+    size_t sz = sizeof(struct frontcode_header) + keys_size + (nblocks + 1) * sizeof(uint64_t) + data_size;
+    char *buf = (char *) calloc(sz, 1);
+    if (buf == 0)
+    {
+	fprintf(stderr, "frontcode_build: cannot allocate %zu bytes\n", sz);
+	return 0;
+    }
+
+    struct frontcode_header *hdr = (struct frontcode_header *) buf;
+    hdr->count = count;
+    hdr->key_len = key_len;
+    hdr->block_len = block_len;
+    hdr->nblocks = nblocks;
+    hdr->data_size = data_size;
+
+    unsigned char *first = (unsigned char *) buf + sizeof(*hdr);
+    uint64_t *offsets = (uint64_t *) (first + keys_size);
+    unsigned char *out = (unsigned char *) (offsets + nblocks + 1);
+    unsigned char *p = out;
+    for (n = 0; n < count; n++)
+    {
+	const unsigned char *key = keys + n * key_len;
+	if (n % block_len == 0)
+	{
+	    memcpy(first + (n / block_len) * key_len, key, key_len);
+	    offsets[n / block_len] = p - out;
+	    continue;
+	}
+	int s = shared_prefix(key - key_len, key, key_len);
+	*p++ = s;
+	memcpy(p, key + s, key_len - s);
+	p += key_len - s;
+    }
+    offsets[nblocks] = p - out;
+
+    *data = buf;
+    *size = sz;
+    return 1;
+}
+
+int frontcode_load(struct frontcode_index *idx, const void *data, size_t size)
+{
+    const struct frontcode_header *hdr = (const struct frontcode_header *) data;
+    if (size < sizeof(*hdr) || hdr->key_len < 1 || hdr->key_len > FRONTCODE_MAX_KEY ||
+	hdr->block_len < 1 || hdr->nblocks != (hdr->count + hdr->block_len - 1) / hdr->block_len)
+    {
+	fprintf(stderr, "frontcode_load: index has invalid header\n");
+	return 0;
+    }
+    size_t keys_size = ROUND8(hdr->nblocks * hdr->key_len);
+    if (size != sizeof(*hdr) + keys_size + (hdr->nblocks + 1) * sizeof(uint64_t) + hdr->data_size)
+    {
+	fprintf(stderr, "frontcode_load: index has invalid size %zu\n", size);
+	return 0;
+    }
+
+    idx->count = hdr->count;
+    idx->key_len = hdr->key_len;
+    idx->block_len = hdr->block_len;
+    idx->nblocks = hdr->nblocks;
+    idx->first_keys = (const unsigned char *) data + sizeof(*hdr);
+    idx->offsets = (const uint64_t *) (idx->first_keys + keys_size);
+    idx->data = (const unsigned char *) (idx->offsets + hdr->nblocks + 1);
+    return 1;
+}
+
+long frontcode_find(const struct frontcode_index *idx, const unsigned char *key)
+{
+    if (idx->count == 0)
+	return -1;
+
+    /*
+     * Find the last block starting at or before key.
+     */
+    int kl = idx->key_len;
+    uint64_t b = 0;
+    uint64_t n = idx->nblocks;
+    while (n > 1)
+    {
+	uint64_t half = n / 2;
+	b = memcmp(idx->first_keys + (b + half) * kl, key, kl) <= 0 ? b + half : b;
+	n -= half;
+    }
+
+    const unsigned char *first = idx->first_keys + b * kl;
+    int m = shared_prefix(first, key, kl);
+    if (m == kl)
+	return b * idx->block_len;
+    if (first[m] > key[m])
+	return -1;
+
+    /*
+     * m is the length of the prefix the current key shares with key,
+     * which is below it. A key sharing more than m bytes with the one
+     * before it is still below key; one sharing fewer is above it.
+     */
+    const unsigned char *p = idx->data + idx->offsets[b];
+    const unsigned char *end = idx->data + idx->offsets[b + 1];
+    long entry = b * idx->block_len;
+    while (p < end)
+    {
+	int s = *p++;
+	entry++;
+	if (s < m)
+	    return -1;
+	if (s == m)
+	{
+	    while (m < kl && p[m - s] == key[m])
+		m++;
+	    if (m == kl)
+		return entry;
+	    if (p[m - s] > key[m])
+		return -1;
+	}
+	p += kl - s;
+    }
+    return -1;
+}
@@ -0,0 +1,71 @@
+#ifndef _frontcode_h
+#define _frontcode_h
+
+/*
+ * Front-coded blocks of sorted keys.
+ *
+ * Sorted motifs share long prefixes with their neighbours, so instead
+ * of storing every key in full, keys are grouped in blocks of
+ * block_len entries. The first key of each block is kept in full in a
+ * small block index; each following key is stored as the number of
+ * leading bytes it shares with the key before it, then its remaining
+ * bytes. A lookup binary searches the block index, then decodes one
+ * block from its start.
+ *
+ * Keys are compared as bytes, so packed keys are coded in big-endian
+ * order.
+ *
+ * The serialized index is a frontcode_header, the first keys of the
+ * blocks (padded to a multiple of 8 bytes), the nblocks + 1 offsets of
+ * the blocks in the coded data, and the coded data.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRONTCODE_BLOCK 64
+#define FRONTCODE_MAX_KEY 255
+
+struct frontcode_header
+{
+    uint64_t count;
+    uint32_t key_len;
+    uint32_t block_len;
+    uint64_t nblocks;
+    uint64_t data_size;
+    uint64_t reserved[4];
+};
+
+struct frontcode_index
+{
+    uint64_t count;
+    int key_len;
+    int block_len;
+    uint64_t nblocks;
+    const unsigned char *first_keys;
+    const uint64_t *offsets;
+    const unsigned char *data;
+};
+
+/*
+ * Code count sorted keys of key_len bytes each.
+ */
+int frontcode_build(const unsigned char *keys, uint64_t count, int key_len, int block_len,
+		    void **data, size_t *size);
+int frontcode_load(struct frontcode_index *idx, const void *data, size_t size);
+
+/*
+ * Return the entry number of key, or -1.
+ */
+long frontcode_find(const struct frontcode_index *idx, const unsigned char *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _frontcode_h */
@@ -0,0 +1,70 @@
+#ifndef _hash_h
+#define _hash_h
+
+/*
+ * 64-bit hashes of table keys, for the hashed indexes and filters.
+ *
+ * Packed keys are hashed as integers and raw motifs as bytes, so an
+ * index must be built and probed with the same kind of key. Derived
+ * hashes for multiple probes come from rehashing with hash_seed.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Finalizer from MurmurHash3.
+ */
+inline uint64_t hash_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline uint64_t hash_key(uint64_t key)
+{
+    return hash_mix(key + 0x9e3779b97f4a7c15ULL);
+}
+
+inline uint64_t hash_motif(const char *motif, int len)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (uint64_t) len;
+    while (len >= 8)
+    {
+	uint64_t w;
+	memcpy(&w, motif, 8);
+	h = hash_mix(h ^ w);
+	motif += 8;
+	len -= 8;
+    }
+    uint64_t w = 0;
+    memcpy(&w, motif, len);
+    return hash_mix(h ^ w);
+}
+
+inline uint64_t hash_seed(uint64_t h, uint64_t seed)
+{
+    return hash_mix(h ^ (seed * 0xd6e8feb86659fd93ULL));
+}
+
+/*
+ * Map a hash uniformly onto [0, n) without a division.
+ */
+inline uint64_t hash_range(uint64_t h, uint64_t n)
+{
+    return (uint64_t) (((unsigned __int128) h * n) >> 64);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _hash_h */
@@ -1,19 +1,31 @@
 extern "C" {
     #include "table.h"
+    #include "motif_key.h"
 };
 
 #include "kmers.h"
 #include <string.h>
+#include <ctype.h>
 #include <map>
 #include <algorithm>
 #include <errno.h>
 #include <netinet/in.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 
 Kmers::Kmers()
 {
     memset(&mtable, 0, sizeof(mtable));
     mtable.mapped_fd = -1;
+    lookup_table = &mtable;
+    map_opts = 0;
+    sharded = 0;
+    memset(&shard_set, 0, sizeof(shard_set));
+    has_delta = 0;
+    memset(&delta_table, 0, sizeof(delta_table));
+    delta_table.mapped_fd = -1;
+    reloading = 0;
 
     char *d = getenv("DEBUG");
     debug = d ? atoi(d) : 0;
@@ -22,15 +34,36 @@ Kmers::Kmers()
 
 Kmers::~Kmers()
 {
+    if (reloading)
+	wait_reload();
     if (mtable.mapped_fd >= 0)
     {
 	unmap_table(&mtable);
     }
+    if (sharded)
+	free_shard_set(&shard_set);
+    if (has_delta)
+	unmap_table(&delta_table);
 }
 
-int Kmers::open_data(char *file)
+int Kmers::open_data(char *file, const char *residency)
 {
-    if (!map_table(file, &mtable))
+    if (residency && !parse_map_opts(residency, &map_opts))
+	return 0;
+
+    if (is_shard_manifest(file))
+    {
+	if (!read_shard_manifest(file, &shard_set))
+	{
+	    fprintf(stderr, "error reading shard manifest %s\n", file);
+	    return 0;
+	}
+	shard_set.map_opts = map_opts & ~MOTIF_MAP_NUMA;
+	sharded = 1;
+	return 1;
+    }
+
+    if (!acquire_table(file, &mtable, map_opts))
     {
 	fprintf(stderr, "error mapping %s\n", file);
 	return 0;
@@ -43,9 +76,35 @@ int Kmers::open_data(char *file)
     for (int i = 0; i < mtable.header.num_attrs; i++)
 	attr_len.push_back(mtable.header.attr_len[i]);
 
+    init_node_tables();
     return 1;
 }
 
+/*
+ * Set up this object's views of the table's NUMA replicas, which have
+ * their own search methods as mtable does. Nodes without a replica
+ * use mtable.
+ */
+void Kmers::init_node_tables()
+{
+    node_tables.clear();
+    for (int node = 0; node < mtable.nreplicas; node++)
+    {
+	struct motif_table *rep = mtable.replicas[node];
+	node_tables.push_back(rep ? *rep : mtable);
+	::set_search_method(&node_tables.back(), mtable.search_method);
+    }
+    lookup_table = &mtable;
+}
+
+int Kmers::get_replica_count()
+{
+    int n = 0;
+    for (int node = 0; node < mtable.nreplicas; node++)
+	n += mtable.replicas[node] != 0;
+    return n;
+}
+
 bool max_elt(const std::pair<unsigned int, int> &lhs,
 	     const std::pair<unsigned int, int> &rhs)
 {
@@ -53,9 +112,160 @@ bool max_elt(const std::pair<unsigned int, int> &lhs,
 }
 
     
-int Kmers::find_hit(char *motif, std::vector<int> &attrs)
+double Kmers::get_warmup_time()
+{
+    double t = mtable.warmup_seconds + (has_delta ? delta_table.warmup_seconds : 0);
+    for (int i = 0; i < shard_set.nshards; i++)
+	if (shard_set.shards[i].mapped)
+	    t += shard_set.shards[i].table.warmup_seconds;
+    return t;
+}
+
+long Kmers::get_page_size()
+{
+    for (int i = 0; i < shard_set.nshards; i++)
+	if (shard_set.shards[i].mapped)
+	    return shard_set.shards[i].table.page_size;
+    return mtable.page_size;
+}
+
+void Kmers::set_max_mapped_shards(int max)
+{
+    shard_set.max_mapped = max;
+}
+
+int Kmers::open_delta(char *file)
+{
+    if (has_delta)
+    {
+	unmap_table(&delta_table);
+	has_delta = 0;
+    }
+    if (!acquire_table(file, &delta_table, map_opts & ~MOTIF_MAP_NUMA))
+    {
+	fprintf(stderr, "error mapping %s\n", file);
+	return 0;
+    }
+    /*
+     * Every shard has the same attributes, so the first one that maps
+     * stands for a sharded table.
+     */
+    struct motif_table *base = sharded ? first_shard_table(&shard_set) : &mtable;
+    if (!(delta_table.header.flags & MOTIF_TABLE_DELTA) ||
+	delta_table.header.motif_len != get_motif_len() ||
+	(base && delta_table.header.num_attrs != base->header.num_attrs))
+    {
+	fprintf(stderr, "%s is not a delta table for this table\n", file);
+	unmap_table(&delta_table);
+	return 0;
+    }
+    has_delta = 1;
+    return 1;
+}
+
+int Kmers::reload(char *file)
+{
+    if (reloading || sharded)
+    {
+	fprintf(stderr, "Kmers: cannot reload %s %s\n", file,
+		reloading ? "while another reload is under way" : "over a sharded table");
+	return 0;
+    }
+    reload_file = file;
+    reload_done = 0;
+    if (pthread_create(&reload_thread, 0, reload_main, this) != 0)
+    {
+	fprintf(stderr, "Kmers: cannot start reload of %s: %s\n", file, strerror(errno));
+	return 0;
+    }
+    reloading = 1;
+    return 1;
+}
+
+void *Kmers::reload_main(void *arg)
+{
+    Kmers *k = (Kmers *) arg;
+    char *file = (char *) k->reload_file.c_str();
+    k->reload_ok = acquire_table(file, &k->reload_table, k->map_opts);
+    if (k->reload_ok && (k->reload_table.header.motif_len != k->mtable.header.motif_len ||
+			 k->reload_table.header.num_attrs != k->mtable.header.num_attrs))
+    {
+	fprintf(stderr, "Kmers: %s does not match the motif length and attributes of %s\n",
+		file, k->mtable.mapped_file);
+	unmap_table(&k->reload_table);
+	k->reload_ok = 0;
+    }
+    __atomic_store_n(&k->reload_done, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void *release_main(void *arg)
 {
-    int n = find_in_range(&mtable, motif, 0, mtable.len);
+    struct motif_table *tbl = (struct motif_table *) arg;
+    unmap_table(tbl);
+    delete tbl;
+    return 0;
+}
+
+int Kmers::wait_reload()
+{
+    return reloading ? finish_reload() : 0;
+}
+
+int Kmers::finish_reload()
+{
+    pthread_join(reload_thread, 0);
+    reloading = 0;
+    if (!reload_ok)
+	return 0;
+
+    /*
+     * Keep the chosen search method if the new table supports it.
+     */
+    int method = mtable.search_method;
+    struct motif_table *old = new motif_table(mtable);
+    mtable = reload_table;
+    if (!::set_search_method(&mtable, method))
+	::set_search_method(&mtable, SEARCH_AUTO);
+    init_node_tables();
+
+    pthread_t t;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&t, &attr, release_main, old) != 0)
+	release_main(old);
+    pthread_attr_destroy(&attr);
+    return 1;
+}
+
+struct motif_table *Kmers::table_for(int shard)
+{
+    if (shard == DELTA_SHARD)
+	return &delta_table;
+    return sharded ? get_shard_table(&shard_set, shard) : lookup_table;
+}
+
+long Kmers::find_hit(char *motif, std::vector<int> &attrs)
+{
+    begin_lookup();
+    if (has_delta)
+    {
+	long n = find_in_range(&delta_table, motif, 0, delta_table.len);
+	if (n >= 0)
+	{
+	    if (is_tombstone(&delta_table, n))
+		return -1;
+	    get_attrs(DELTA_SHARD, n, attrs);
+	    return n;
+	}
+    }
+
+    int shard = sharded ? find_shard(&shard_set, motif) : 0;
+    struct motif_table *tbl = shard >= 0 ? table_for(shard) : 0;
+    if (tbl == 0)
+	return -1;
+    long n = find_in_range(tbl, motif, 0, tbl->len);
 #if 0
     char qmotif[12];
     strncpy(qmotif, motif, mtable.header.motif_len);
@@ -65,45 +275,340 @@ int Kmers::find_hit(char *motif, std::vector<int> &attrs)
 #endif
     if (n >= 0)
     {
-	char *ptr = get_motif_at(&mtable, n);
-	ptr += mtable.header.motif_len;
+	get_attrs(shard, n, attrs);
+	return n;
+    }
+    else
+	return -1;
+}
 
-	attrs.reserve(attr_len.size());
-	attrs.clear();
-	for (int i = 0; i < attr_len.size(); i++)
+void Kmers::get_attrs(long n, std::vector<int> &attrs)
+{
+    get_attrs(0, n, attrs);
+}
+
+void Kmers::get_attrs(int shard, long n, std::vector<int> &attrs)
+{
+    struct motif_table *tbl = table_for(shard);
+    attrs.clear();
+    if (tbl == 0)
+	return;
+    attrs.reserve(tbl->header.num_attrs);
+    for (int i = 0; i < tbl->header.num_attrs; i++)
+	attrs.push_back(get_attr_value(tbl, n, i));
+}
+
+int Kmers::set_search_method(const char *method)
+{
+    for (int m = SEARCH_AUTO; search_method_name(m); m++)
+    {
+	if (strcmp(method, search_method_name(m)) == 0)
 	{
-	    int v = 0;
-	    switch(attr_len[i])
+	    if (sharded ? set_shard_search_method(&shard_set, m) : ::set_search_method(&mtable, m))
 	    {
-	    case 1:
-		v  = (int) *ptr;
-		ptr++;
-		break;
-
-	    case 2:
-		v = (int) ntohs(*((short *) ptr));
-		ptr += 2;
-		break;
-
-	    case 4:
-		v = *((int *) ptr);
-		v = ntohl(v);
-		ptr += 4;
-		break;
+		for (size_t i = 0; i < node_tables.size(); i++)
+		    ::set_search_method(&node_tables[i], m);
+		return 1;
 	    }
-	    attrs.push_back(v);
+	    fprintf(stderr, "Kmers: table does not have an index for search method %s\n", method);
+	    return 0;
 	}
-	return n;
     }
+    fprintf(stderr, "Kmers: unknown search method %s\n", method);
+    return 0;
+}
+
+void Kmers::find_hits(char **motifs, int count, long *results, int *shards)
+{
+    begin_lookup();
+    if (shards == 0 && (sharded || has_delta))
+    {
+	scan_shards.resize(count);
+	shards = count ? &scan_shards[0] : 0;
+    }
+    if (sharded)
+	find_sharded(motifs, 0, count, results, shards);
     else
-	return -1;
+    {
+	find_motifs_batch(lookup_table, motifs, count, results);
+	if (shards)
+	    memset(shards, 0, count * sizeof(*shards));
+    }
+    if (has_delta)
+    {
+	delta_results.resize(count);
+	find_motifs_batch(&delta_table, motifs, count, count ? &delta_results[0] : 0);
+	overlay_delta(count ? &delta_results[0] : 0, count, results, shards);
+    }
+}
+
+/*
+ * Let the delta's lookup results override the base's: a delta entry
+ * replaces the base one, and a tombstone hides it.
+ */
+void Kmers::overlay_delta(const long *delta, int count, long *results, int *shards)
+{
+    for (int i = 0; i < count; i++)
+    {
+	if (delta[i] < 0)
+	    continue;
+	if (is_tombstone(&delta_table, delta[i]))
+	    results[i] = -1;
+	else
+	{
+	    results[i] = delta[i];
+	    shards[i] = DELTA_SHARD;
+	}
+    }
+}
+
+/*
+ * Route each motif to its shard, then look up each shard's motifs as
+ * one batch. keys, if given, are the packed keys of the motifs, used
+ * for shards with packed keys.
+ */
+void Kmers::find_sharded(char **motifs, const uint64_t *keys, int count, long *results, int *shards)
+{
+    int nshards = shard_set.nshards;
+    shard_start.assign(nshards + 1, 0);
+    for (int i = 0; i < count; i++)
+    {
+	shards[i] = find_shard(&shard_set, motifs[i]);
+	results[i] = -1;
+	if (shards[i] >= 0)
+	    shard_start[shards[i] + 1]++;
+    }
+    for (int s = 0; s < nshards; s++)
+	shard_start[s + 1] += shard_start[s];
+
+    /*
+     * Counting sort of the motifs by shard, keeping their order
+     * within a shard.
+     */
+    shard_order.resize(count);
+    shard_results.resize(count);
+    std::vector<int> next(shard_start.begin(), shard_start.end() - 1);
+    for (int i = 0; i < count; i++)
+	if (shards[i] >= 0)
+	    shard_order[next[shards[i]]++] = i;
+
+    for (int s = 0; s < nshards; s++)
+    {
+	int start = shard_start[s];
+	int n = shard_start[s + 1] - start;
+	if (n == 0)
+	    continue;
+	struct motif_table *tbl = get_shard_table(&shard_set, s);
+	if (tbl == 0)
+	    continue;
+	if (keys && (tbl->header.flags & MOTIF_TABLE_PACKED_KEYS))
+	{
+	    shard_keys.resize(n);
+	    for (int j = 0; j < n; j++)
+		shard_keys[j] = keys[shard_order[start + j]];
+	    find_keys_batch(tbl, &shard_keys[0], n, &shard_results[start]);
+	}
+	else
+	{
+	    shard_motifs.resize(n);
+	    for (int j = 0; j < n; j++)
+		shard_motifs[j] = motifs[shard_order[start + j]];
+	    find_motifs_batch(tbl, &shard_motifs[0], n, &shard_results[start]);
+	}
+	for (int j = 0; j < n; j++)
+	    results[shard_order[start + j]] = shard_results[start + j];
+    }
+}
+
+int Kmers::scan(const char *seq, size_t len, std::vector<motif_hit> &hits)
+{
+    begin_lookup();
+    int mlen = get_motif_len();
+    if (len < mlen)
+	return 0;
+
+    size_t nwin = len - mlen + 1;
+    scan_results.resize(nwin);
+
+    /*
+     * Packed-key tables take the query translated once, with the
+     * packed key rolled along it, rather than re-encoding motif_len
+     * characters per window. Sharded tables need the window pointers
+     * for routing, and the keys too for any shards with packed keys.
+     */
+    int base_packed = !sharded && (mtable.header.flags & MOTIF_TABLE_PACKED_KEYS);
+    int delta_packed = has_delta && (delta_table.header.flags & MOTIF_TABLE_PACKED_KEYS);
+    const uint64_t *keys = 0;
+    if (base_packed || delta_packed || (sharded && mlen <= MAX_PACKED_MOTIF_LEN))
+    {
+	scan_codes.resize(len);
+	scan_keys.resize(nwin);
+	encode_residues(seq, len, &scan_codes[0]);
+	encode_windows(&scan_codes[0], len, mlen, &scan_keys[0]);
+	keys = &scan_keys[0];
+    }
+    if (!base_packed || (has_delta && !delta_packed))
+    {
+	scan_motifs.resize(nwin);
+	for (size_t i = 0; i < nwin; i++)
+	    scan_motifs[i] = (char *) seq + i;
+    }
+    int *shards = 0;
+    if (sharded || has_delta)
+    {
+	scan_shards.assign(nwin, 0);
+	shards = &scan_shards[0];
+    }
+
+    if (sharded)
+	find_sharded(&scan_motifs[0], keys, nwin, &scan_results[0], shards);
+    else if (base_packed)
+	find_keys_batch(lookup_table, keys, nwin, &scan_results[0]);
+    else
+	find_motifs_batch(lookup_table, &scan_motifs[0], nwin, &scan_results[0]);
+
+    if (has_delta)
+    {
+	delta_results.resize(nwin);
+	if (delta_packed)
+	    find_keys_batch(&delta_table, keys, nwin, &delta_results[0]);
+	else
+	    find_motifs_batch(&delta_table, &scan_motifs[0], nwin, &delta_results[0]);
+	overlay_delta(&delta_results[0], nwin, &scan_results[0], shards);
+    }
+
+    int found = 0;
+    for (size_t i = 0; i < nwin; i++)
+    {
+	if (scan_results[i] >= 0)
+	{
+	    motif_hit h = { (int) i, scan_results[i], shards ? shards[i] : 0 };
+	    hits.push_back(h);
+	    found++;
+	}
+    }
+    return found;
+}
+
+KmersMulti::KmersMulti()
+{
+    memset(&mk, 0, sizeof(mk));
+    mk.mapped_fd = -1;
+}
+
+KmersMulti::~KmersMulti()
+{
+    if (mk.mapped_fd >= 0)
+	unmap_multik(&mk);
+}
+
+int KmersMulti::open_data(char *file, const char *residency)
+{
+    int opts = 0;
+    if (residency && !parse_map_opts(residency, &opts))
+	return 0;
+    if (mk.mapped_fd >= 0)
+	unmap_multik(&mk);
+    if (!map_multik(file, &mk, opts))
+    {
+	fprintf(stderr, "error mapping %s\n", file);
+	return 0;
+    }
+    scan_results.resize(mk.ntables);
+    return 1;
+}
+
+void KmersMulti::get_attrs(int t, long n, std::vector<int> &attrs)
+{
+    int num_attrs = mk.tables[t].header.num_attrs;
+    attrs.reserve(num_attrs);
+    attrs.clear();
+    for (int i = 0; i < num_attrs; i++)
+	attrs.push_back(get_attr_value(&mk.tables[t], n, i));
+}
+
+int KmersMulti::scan(const char *seq, size_t len, std::vector<multik_hit> &hits)
+{
+    /*
+     * The tables are in increasing order of motif length, so the first
+     * has the most windows.
+     */
+    if (mk.ntables == 0 || len < mk.tables[0].header.motif_len)
+	return 0;
+    size_t maxwin = len - mk.tables[0].header.motif_len + 1;
+
+    int coded = 0;
+    int pointed = 0;
+    for (int t = 0; t < mk.ntables; t++)
+    {
+	struct motif_table *tbl = &mk.tables[t];
+	int mlen = tbl->header.motif_len;
+	std::vector<long> &results = scan_results[t];
+	if (len < mlen)
+	{
+	    results.clear();
+	    continue;
+	}
+	size_t nwin = len - mlen + 1;
+	results.resize(nwin);
+
+	if (tbl->header.flags & MOTIF_TABLE_PACKED_KEYS)
+	{
+	    if (!coded)
+	    {
+		scan_codes.resize(len);
+		scan_keys.resize(maxwin);
+		encode_residues(seq, len, &scan_codes[0]);
+		coded = 1;
+	    }
+	    encode_windows(&scan_codes[0], len, mlen, &scan_keys[0]);
+	    find_keys_batch(tbl, &scan_keys[0], nwin, &results[0]);
+	}
+	else
+	{
+	    if (!pointed)
+	    {
+		scan_motifs.resize(maxwin);
+		for (size_t i = 0; i < maxwin; i++)
+		    scan_motifs[i] = (char *) seq + i;
+		pointed = 1;
+	    }
+	    find_motifs_batch(tbl, &scan_motifs[0], nwin, &results[0]);
+	}
+    }
+
+    int found = 0;
+    for (size_t i = 0; i < maxwin; i++)
+    {
+	for (int t = 0; t < mk.ntables; t++)
+	{
+	    const std::vector<long> &results = scan_results[t];
+	    if (i < results.size() && results[i] >= 0)
+	    {
+		multik_hit h = { (int) i, (int) mk.tables[t].header.motif_len, t, results[i] };
+		hits.push_back(h);
+		found++;
+	    }
+	}
+    }
+    return found;
 }
 
 KmersFileCreator::KmersFileCreator(int magic, int motif_len, int pad_len, const std::vector<int> &attr_len) :
     magic(magic),
     motif_len(motif_len),
     pad_len(pad_len),
-    attr_len(attr_len)
+    flags(0),
+    version(1),
+    fp(0),
+    rows_fp(0),
+    rows_buf(0),
+    rows_size(0),
+    nentries(0),
+    header_written(0),
+    attr_len(attr_len),
+    indexes(0),
+    bloom_fpr(0)
 {
     if (pad_len)
 	padding = (char *) calloc(pad_len, 1);
@@ -118,6 +623,20 @@ KmersFileCreator::KmersFileCreator(int magic, int motif_len, int pad_len, const
 
 KmersFileCreator::~KmersFileCreator()
 {
+    /*
+     * Release the buffers of a table that was never closed.
+     */
+    if (rows_fp && rows_fp != fp)
+	fclose(rows_fp);
+    free(rows_buf);
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+	if (columns[i].fp)
+	    fclose(columns[i].fp);
+	free(columns[i].buf);
+    }
+    if (fp)
+	fclose(fp);
     if (padding)
 	free(padding);
 }
@@ -130,101 +649,843 @@ int KmersFileCreator::open_file(char *file)
 	fprintf(stderr, "error opening %s: %s", file, strerror(errno));
 	return 0;
     }
+    this->file = file;
+    rows_fp = fp;
+    header_written = 0;
+
+    /*
+     * Any index sidecars belong to the table we are replacing.
+     */
+    unlink((this->file + EYTZINGER_SUFFIX).c_str());
+    unlink((this->file + STREE_SUFFIX).c_str());
+    unlink((this->file + BLOOM_SUFFIX).c_str());
+    unlink((this->file + MPHF_SUFFIX).c_str());
+    unlink((this->file + PGM_SUFFIX).c_str());
     return 1;
 }
 
 int KmersFileCreator::close_file()
 {
-    if (fp)
+    if (fp && !header_written)
     {
+	/*
+	 * write_file_header failed or was never called, so there is no
+	 * table to finish.
+	 */
+	if (rows_fp && rows_fp != fp)
+	    fclose(rows_fp);
+	free(rows_buf);
+	rows_fp = 0;
+	rows_buf = 0;
 	fclose(fp);
 	fp = 0;
-	return 1;
+	return 0;
+    }
+    if (fp)
+    {
+	int ok = 1;
+	if (rows_fp != fp && (flags & MOTIF_TABLE_CUCKOO))
+	    ok = write_cuckoo_rows();
+	if (version >= 2)
+	    ok = finish_v2_table() && ok;
+	rows_fp = 0;
+	if (fclose(fp) != 0)
+	    ok = 0;
+	fp = 0;
+	if (version < 2)
+	    ok = build_indexes() && ok;
+	return ok;
+    }
+    else
+	return 0;
+}
+
+int KmersFileCreator::set_index(int index, int on, const char *name)
+{
+    if (on && !(flags & MOTIF_TABLE_PACKED_KEYS))
+    {
+	fprintf(stderr, "KmersFileCreator: %s index requires packed keys\n", name);
+	return 0;
+    }
+    if (on)
+	indexes |= index;
+    else
+	indexes &= ~index;
+    return 1;
+}
+
+int KmersFileCreator::set_eytzinger_index(int on)
+{
+    return set_index(INDEX_EYTZINGER, on, "eytzinger");
+}
+
+int KmersFileCreator::set_stree_index(int on)
+{
+    return set_index(INDEX_STREE, on, "stree");
+}
+
+int KmersFileCreator::set_pgm_index(int on)
+{
+    return set_index(INDEX_PGM, on, "pgm");
+}
+
+int KmersFileCreator::set_mphf_index(int on)
+{
+    if (on)
+	indexes |= INDEX_MPHF;
+    else
+	indexes &= ~INDEX_MPHF;
+    return 1;
+}
+
+int KmersFileCreator::set_cuckoo_table(int on)
+{
+    if (on)
+	flags |= MOTIF_TABLE_CUCKOO;
+    else
+	flags &= ~MOTIF_TABLE_CUCKOO;
+    return 1;
+}
+
+/*
+ * Place the buffered entries of a cuckoo table and write them out.
+ */
+int KmersFileCreator::write_cuckoo_rows()
+{
+    fclose(rows_fp);
+    int del = (flags & MOTIF_TABLE_PACKED_KEYS ? sizeof(uint64_t) : motif_len) + pad_len;
+    for (int i = 0; i < attr_len.size(); i++)
+	del += attr_len[i];
+    int ok = cuckoo_write(fp, rows_buf, rows_size / del, del, motif_len, flags, version);
+    free(rows_buf);
+    rows_buf = 0;
+    rows_size = 0;
+    return ok;
+}
+
+int KmersFileCreator::set_columnar_attrs(int on)
+{
+    if (on)
+	flags |= MOTIF_TABLE_COLUMNAR;
+    else
+	flags &= ~(MOTIF_TABLE_COLUMNAR | MOTIF_TABLE_BITPACKED);
+    return 1;
+}
+
+int KmersFileCreator::set_dictionary_attrs(int on)
+{
+    if (on)
+	flags |= MOTIF_TABLE_DICTIONARY;
+    else
+	flags &= ~MOTIF_TABLE_DICTIONARY;
+    return 1;
+}
+
+/*
+ * Append the tuple dictionary and the entries' tuple numbers as
+ * sections.
+ */
+int KmersFileCreator::write_dictionary()
+{
+    std::vector<int32_t> tuples(tuple_ids.size() * attr_len.size());
+    for (std::map<std::vector<int32_t>, int32_t>::iterator it = tuple_ids.begin(); it != tuple_ids.end(); it++)
+	std::copy(it->first.begin(), it->first.end(), tuples.begin() + it->second * attr_len.size());
+
+    fprintf(stderr, "KmersFileCreator: %zu entries share %zu attribute tuples\n",
+	    entry_tuples.size(), tuple_ids.size());
+    int ok = add_table_section(fp, &v2_header, MOTIF_SECTION_TUPLES,
+			       tuples.data(), tuples.size() * sizeof(int32_t));
+    void *data;
+    size_t size;
+    if (ok && bitpack_build(entry_tuples.data(), entry_tuples.size(), 0,
+			    tuple_ids.empty() ? 0 : tuple_ids.size() - 1, &data, &size))
+    {
+	ok = add_table_section(fp, &v2_header, MOTIF_SECTION_TUPLE_IDS, data, size);
+	free(data);
+    }
+    else
+	ok = 0;
+    tuple_ids.clear();
+    entry_tuples.clear();
+    return ok;
+}
+
+int KmersFileCreator::set_bitpacked_attrs(int on)
+{
+    if (on)
+	flags |= MOTIF_TABLE_COLUMNAR | MOTIF_TABLE_BITPACKED;
+    else
+	flags &= ~MOTIF_TABLE_BITPACKED;
+    return 1;
+}
+
+/*
+ * Append the buffered attribute columns as sections.
+ */
+int KmersFileCreator::write_columns()
+{
+    int ok = 1;
+    for (int i = 0; i < columns.size(); i++)
+    {
+	column &c = columns[i];
+	fclose(c.fp);
+	if (flags & MOTIF_TABLE_BITPACKED)
+	{
+	    void *data;
+	    size_t size;
+	    uint64_t count = c.size / sizeof(int32_t);
+	    if (bitpack_build((const int32_t *) c.buf, count, count ? c.min : 0, count ? c.max : 0,
+			      &data, &size))
+	    {
+		ok = add_table_section(fp, &v2_header, MOTIF_SECTION_ATTRS + i, data, size) && ok;
+		free(data);
+	    }
+	    else
+		ok = 0;
+	}
+	else
+	    ok = add_table_section(fp, &v2_header, MOTIF_SECTION_ATTRS + i, c.buf, c.size) && ok;
+	free(c.buf);
+    }
+    columns.clear();
+    return ok;
+}
+
+int KmersFileCreator::set_front_coded_keys(int on)
+{
+    if (on)
+	flags |= MOTIF_TABLE_FRONT_CODED;
+    else
+	flags &= ~MOTIF_TABLE_FRONT_CODED;
+    return 1;
+}
+
+int KmersFileCreator::set_elias_fano_keys(int on)
+{
+    if (on && !(flags & MOTIF_TABLE_PACKED_KEYS))
+    {
+	fprintf(stderr, "KmersFileCreator: Elias-Fano keys require packed keys\n");
+	return 0;
+    }
+    if (on)
+	flags |= MOTIF_TABLE_ELIAS_FANO;
+    else
+	flags &= ~MOTIF_TABLE_ELIAS_FANO;
+    return 1;
+}
+
+int KmersFileCreator::set_delta_table(int on)
+{
+    if (on)
+	flags |= MOTIF_TABLE_DELTA;
+    else
+	flags &= ~MOTIF_TABLE_DELTA;
+    return 1;
+}
+
+/*
+ * Append the tombstone bitmap of a delta table as a section.
+ */
+int KmersFileCreator::write_tombstones()
+{
+    tombstones.resize((v2_header.count + 63) / 64);
+    int ok = add_table_section(fp, &v2_header, MOTIF_SECTION_TOMBSTONES,
+			       tombstones.data(), tombstones.size() * sizeof(uint64_t));
+    tombstones.clear();
+    return ok;
+}
+
+/*
+ * Encode the buffered keys into their section.
+ */
+int KmersFileCreator::write_encoded_keys()
+{
+    fclose(rows_fp);
+    int key_len = flags & MOTIF_TABLE_PACKED_KEYS ? sizeof(uint64_t) : motif_len;
+    uint64_t count = rows_size / key_len;
+    void *data;
+    size_t size;
+    int ok;
+    if ((flags & MOTIF_TABLE_ELIAS_FANO) && !(flags & MOTIF_TABLE_PACKED_KEYS))
+    {
+	/*
+	 * set_packed_keys(0) after write_file_header: the buffer holds
+	 * motifs, not keys.
+	 */
+	fprintf(stderr, "KmersFileCreator: Elias-Fano keys require packed keys\n");
+	ok = 0;
     }
+    else if (flags & MOTIF_TABLE_ELIAS_FANO)
+	ok = ef_build((const uint64_t *) rows_buf, count, &data, &size);
     else
+	ok = frontcode_build((const unsigned char *) rows_buf, count, key_len, FRONTCODE_BLOCK, &data, &size);
+    free(rows_buf);
+    rows_buf = 0;
+    rows_size = 0;
+    if (!ok)
 	return 0;
+
+    fprintf(stderr, "KmersFileCreator: encoded %lu keys in %zu bytes\n", (unsigned long) count, size);
+    v2_header.count = count;
+    ok = add_table_section(fp, &v2_header,
+			   flags & MOTIF_TABLE_ELIAS_FANO ? MOTIF_SECTION_ELIAS_FANO : MOTIF_SECTION_FRONT_CODED,
+			   data, size);
+    free(data);
+    return ok;
+}
+
+int KmersFileCreator::set_format_version(int version)
+{
+    if (version != 1 && version != 2)
+    {
+	fprintf(stderr, "KmersFileCreator: unknown table format version %d\n", version);
+	return 0;
+    }
+    this->version = version;
+    return 1;
+}
+
+/*
+ * Record the entries written so far in the version 2 header, then
+ * append the attribute columns or dictionary and the requested indexes
+ * as sections.
+ */
+int KmersFileCreator::finish_v2_table()
+{
+    if (rows_fp != fp && (flags & MOTIF_TABLE_ENCODED_KEYS))
+    {
+	if (!write_encoded_keys())
+	    return 0;
+    }
+    else
+    {
+	if (fseek(fp, 0, SEEK_END) != 0)
+	    return 0;
+	long end = ftell(fp);
+	uint64_t size = end - sizeof(v2_header);
+	v2_header.count = size / v2_header.data_entry_len;
+	v2_header.sections[0].type = MOTIF_SECTION_ENTRIES;
+	v2_header.sections[0].offset = sizeof(v2_header);
+	v2_header.sections[0].size = v2_header.count * v2_header.data_entry_len;
+	v2_header.nsections = 1;
+	if (!write_file_header_v2(fp, &v2_header))
+	    return 0;
+    }
+    if (v2_header.count > INT32_MAX)
+    {
+	v2_header.flags |= MOTIF_TABLE_LARGE;
+	if (!write_file_header_v2(fp, &v2_header))
+	    return 0;
+    }
+    if (!write_columns())
+	return 0;
+    if ((flags & MOTIF_TABLE_DICTIONARY) && !write_dictionary())
+	return 0;
+    if ((flags & MOTIF_TABLE_DELTA) && !write_tombstones())
+	return 0;
+    if (fflush(fp) != 0)
+	return 0;
+    return build_indexes();
+}
+
+int KmersFileCreator::store_index(struct motif_table *tbl, const char *suffix, uint32_t magic,
+				  const void *data, size_t size)
+{
+    if (version >= 2)
+	return add_table_section(fp, &v2_header, magic, data, size);
+    return write_sidecar(tbl, suffix, magic, data, size);
+}
+
+int KmersFileCreator::set_bloom_filter(double fpr)
+{
+    if (fpr < 0 || fpr >= 1)
+    {
+	fprintf(stderr, "KmersFileCreator: bloom filter false positive rate %g out of range\n", fpr);
+	return 0;
+    }
+    bloom_fpr = fpr;
+    return 1;
+}
+
+int KmersFileCreator::write_index(struct motif_table *tbl, const char *suffix, uint32_t magic,
+				  int (*build)(struct motif_table *, void **, size_t *))
+{
+    void *data;
+    size_t size;
+    if (!build(tbl, &data, &size))
+	return 0;
+    int ok = store_index(tbl, suffix, magic, data, size);
+    free(data);
+    return ok;
+}
+
+/*
+ * Map the table we just wrote and build the requested indexes, as
+ * sidecars or, for a version 2 table, as sections.
+ */
+int KmersFileCreator::build_indexes()
+{
+    if (indexes == 0 && bloom_fpr == 0)
+	return 1;
+    if (flags & (MOTIF_TABLE_CUCKOO | MOTIF_TABLE_ENCODED_KEYS))
+    {
+	fprintf(stderr, "KmersFileCreator: search indexes are not built for cuckoo tables or encoded keys\n");
+	return 1;
+    }
+
+    struct motif_table tbl;
+    memset(&tbl, 0, sizeof(tbl));
+    if (!map_table((char *) file.c_str(), &tbl))
+	return 0;
+
+    int ok = 1;
+    if (indexes & INDEX_EYTZINGER)
+	ok = write_index(&tbl, EYTZINGER_SUFFIX, EYTZINGER_MAGIC, eytzinger_build) && ok;
+    if (indexes & INDEX_STREE)
+	ok = write_index(&tbl, STREE_SUFFIX, STREE_MAGIC, stree_build) && ok;
+    if (indexes & INDEX_MPHF)
+	ok = write_index(&tbl, MPHF_SUFFIX, MPHF_MAGIC, mphf_build) && ok;
+    if (indexes & INDEX_PGM)
+	ok = write_index(&tbl, PGM_SUFFIX, PGM_MAGIC, pgm_build) && ok;
+    if (bloom_fpr > 0)
+    {
+	void *data;
+	size_t size;
+	if (bloom_build(&tbl, bloom_fpr, &data, &size))
+	{
+	    ok = store_index(&tbl, BLOOM_SUFFIX, BLOOM_MAGIC, data, size) && ok;
+	    free(data);
+	}
+	else
+	    ok = 0;
+    }
+
+    unmap_table(&tbl);
+    return ok;
+}
+
+int KmersFileCreator::set_packed_keys(int on)
+{
+    if (on && motif_len > MAX_PACKED_MOTIF_LEN)
+    {
+	fprintf(stderr, "KmersFileCreator: motif_len %d too long for packed keys (max %d)\n",
+		motif_len, MAX_PACKED_MOTIF_LEN);
+	return 0;
+    }
+    if (on)
+	flags |= MOTIF_TABLE_PACKED_KEYS;
+    else
+	flags &= ~MOTIF_TABLE_PACKED_KEYS;
+    return 1;
 }
 
 int KmersFileCreator::write_file_header()
 {
-    int alen[32];
+    int alen[MOTIF_MAX_ATTRS];
     int i;
-    for (i = 0; i < 32; i++)
+    if (attr_len.size() > MOTIF_MAX_ATTRS)
+    {
+	fprintf(stderr, "KmersFileCreator: %d attributes, at most %d are supported\n",
+		(int) attr_len.size(), MOTIF_MAX_ATTRS);
+	return -1;
+    }
+    for (i = 0; i < MOTIF_MAX_ATTRS; i++)
     {
 	if (i < attr_len.size())
 	    alen[i] = attr_len[i];
 	else
 	    alen[i] = 0;
     }
-    ::write_file_header(fp, magic, motif_len, pad_len, alen, attr_len.size());
+    if (flags & MOTIF_TABLE_ENCODED_KEYS)
+    {
+	if (version < 2 || (flags & MOTIF_TABLE_CUCKOO) ||
+	    (flags & MOTIF_TABLE_ENCODED_KEYS) == MOTIF_TABLE_ENCODED_KEYS)
+	{
+	    fprintf(stderr, "KmersFileCreator: front-coded or Elias-Fano keys need a version 2 sorted table\n");
+	    flags &= ~MOTIF_TABLE_ENCODED_KEYS;
+	    return -1;
+	}
+	if ((flags & MOTIF_TABLE_ELIAS_FANO) && !(flags & MOTIF_TABLE_PACKED_KEYS))
+	{
+	    fprintf(stderr, "KmersFileCreator: Elias-Fano keys require packed keys\n");
+	    flags &= ~MOTIF_TABLE_ENCODED_KEYS;
+	    return -1;
+	}
+
+	/*
+	 * There are no rows to hold the attributes.
+	 */
+	if (!(flags & MOTIF_TABLE_DICTIONARY))
+	    flags |= MOTIF_TABLE_COLUMNAR;
+    }
+    if ((flags & MOTIF_TABLE_DELTA) &&
+	(version < 2 || (flags & (MOTIF_TABLE_CUCKOO | MOTIF_TABLE_ENCODED_KEYS))))
+    {
+	fprintf(stderr, "KmersFileCreator: a delta table must be a version 2 sorted table without encoded keys\n");
+	flags &= ~MOTIF_TABLE_DELTA;
+	return -1;
+    }
+    if (flags & (MOTIF_TABLE_COLUMNAR | MOTIF_TABLE_DICTIONARY))
+    {
+	if (version < 2 || (flags & MOTIF_TABLE_CUCKOO))
+	{
+	    fprintf(stderr, "KmersFileCreator: columnar or dictionary attributes need a version 2 sorted table\n");
+	    return -1;
+	}
+	if ((flags & MOTIF_TABLE_COLUMNAR) && (flags & MOTIF_TABLE_DICTIONARY))
+	{
+	    fprintf(stderr, "KmersFileCreator: attributes cannot be both columnar and dictionary encoded\n");
+	    return -1;
+	}
+
+	/*
+	 * The keys are packed together; padding only served the rows.
+	 */
+	pad_len = 0;
+	free(padding);
+	padding = 0;
+    }
+    if (flags & MOTIF_TABLE_CUCKOO)
+    {
+	/*
+	 * Pad small entries so that a bucket fills a cache line.
+	 */
+	int del = (flags & MOTIF_TABLE_PACKED_KEYS ? sizeof(uint64_t) : motif_len) + pad_len;
+	for (i = 0; i < attr_len.size(); i++)
+	    del += attr_len[i];
+	if (del < CUCKOO_ENTRY_LEN)
+	{
+	    pad_len += CUCKOO_ENTRY_LEN - del;
+	    free(padding);
+	    padding = (char *) calloc(pad_len, 1);
+	}
+    }
+    if (version >= 2)
+    {
+	init_file_header_v2(&v2_header, magic, motif_len, pad_len, alen, attr_len.size(), flags);
+	write_file_header_v2(fp, &v2_header);
+    }
+    else
+	::write_file_header(fp, magic, motif_len, pad_len, alen, attr_len.size(), flags);
+    if (flags & (MOTIF_TABLE_CUCKOO | MOTIF_TABLE_ENCODED_KEYS))
+    {
+	rows_fp = open_memstream(&rows_buf, &rows_size);
+	if (rows_fp == 0)
+	{
+	    fprintf(stderr, "KmersFileCreator: cannot buffer entries: %s\n", strerror(errno));
+	    rows_fp = fp;
+	    flags &= ~(MOTIF_TABLE_CUCKOO | MOTIF_TABLE_ENCODED_KEYS);
+	    return -1;
+	}
+    }
+    if (flags & MOTIF_TABLE_COLUMNAR)
+    {
+	columns.resize(attr_len.size());
+	for (i = 0; i < columns.size(); i++)
+	{
+	    columns[i].buf = 0;
+	    columns[i].size = 0;
+	    columns[i].min = INT32_MAX;
+	    columns[i].max = INT32_MIN;
+	    columns[i].fp = open_memstream(&columns[i].buf, &columns[i].size);
+	    if (columns[i].fp == 0)
+	    {
+		fprintf(stderr, "KmersFileCreator: cannot buffer attribute column: %s\n", strerror(errno));
+		for (int j = 0; j < i; j++)
+		{
+		    fclose(columns[j].fp);
+		    free(columns[j].buf);
+		}
+		columns.clear();
+		return -1;
+	    }
+	}
+    }
+    header_written = 1;
     return 0;
 }
 
-int KmersFileCreator::write_entry(char *motif, const std::vector<int> &values)
+/*
+ * Write the key portion of an entry. Returns 0 if the motif
+ * cannot be represented in this table.
+ */
+int KmersFileCreator::write_key(char *motif)
 {
-    fwrite(motif, 1, motif_len, fp);
-    char cv;
-    short sv;
-    int iv;
-    for (int i = 0; i < attr_len.size(); i++)
+    if (flags & MOTIF_TABLE_PACKED_KEYS)
     {
-	switch (attr_len[i])
+	uint64_t key;
+	if (!encode_motif(motif, motif_len, &key))
 	{
-	case 1:
-	    cv = (char) values[i];
-	    fwrite(&cv, 1, sizeof(char), fp);
-	    // printf("write char %d\n", cv);
-	    break;
+	    fprintf(stderr, "KmersFileCreator: cannot pack motif %.*s\n", motif_len, motif);
+	    return 0;
+	}
+	if (version < 2 || (flags & MOTIF_TABLE_FRONT_CODED))
+	    key = htobe64(key);
+	fwrite(&key, 1, sizeof(key), rows_fp);
+    }
+    else
+	fwrite(motif, 1, motif_len, rows_fp);
+    return 1;
+}
 
-	case 2:
-	    sv = htons((short) values[i]);
-	    fwrite(&sv, 1, sizeof(short), fp);
-	    // printf("write short %d\n", sv);
-	    break;
+/*
+ * The value as it reads back at attribute i's declared width.
+ */
+int32_t KmersFileCreator::attr_value(int i, int value)
+{
+    if (attr_len[i] == 1)
+	return (char) value;
+    else if (attr_len[i] == 2)
+	return (unsigned short) value;
+    else if (attr_len[i] == 4)
+	return value;
+    return 0;
+}
 
-	case 4:
-	    iv = htonl((int) values[i]);
-	    fwrite(&iv, 1, sizeof(int), fp);
-	    // printf("write int %d\n", iv);
-	    break;
-	}
+void KmersFileCreator::write_attrs(const int values[])
+{
+    if (flags & MOTIF_TABLE_DICTIONARY)
+    {
+	std::vector<int32_t> tuple(attr_len.size());
+	for (int i = 0; i < attr_len.size(); i++)
+	    tuple[i] = attr_value(i, values[i]);
+	std::map<std::vector<int32_t>, int32_t>::iterator it = tuple_ids.find(tuple);
+	if (it == tuple_ids.end())
+	    it = tuple_ids.insert(std::make_pair(tuple, (int32_t) tuple_ids.size())).first;
+	entry_tuples.push_back(it->second);
+	return;
     }
+    for (int i = 0; i < attr_len.size(); i++)
+	write_attr(i, values[i]);
     if (padding)
-	fwrite(padding, 1, pad_len, fp);
-    return 0;
+	fwrite(padding, 1, pad_len, rows_fp);
 }
 
-int KmersFileCreator::write_entry(char *motif, int values[])
+void KmersFileCreator::write_attr(int i, int value)
 {
-    fwrite(motif, 1, motif_len, fp);
+    FILE *out = columns.empty() ? rows_fp : columns[i].fp;
     char cv;
     short sv;
     int iv;
-    for (int i = 0; i < attr_len.size(); i++)
+    if (flags & MOTIF_TABLE_BITPACKED)
+    {
+	int32_t v = attr_value(i, value);
+	column &c = columns[i];
+	if (v < c.min)
+	    c.min = v;
+	if (v > c.max)
+	    c.max = v;
+	fwrite(&v, 1, sizeof(v), out);
+	return;
+    }
+    switch (attr_len[i])
+    {
+    case 1:
+	cv = (char) value;
+	fwrite(&cv, 1, sizeof(char), out);
+	break;
+
+    case 2:
+	sv = version >= 2 ? (short) value : htons((short) value);
+	fwrite(&sv, 1, sizeof(short), out);
+	break;
+
+    case 4:
+	iv = version >= 2 ? (int) value : htonl((int) value);
+	fwrite(&iv, 1, sizeof(int), out);
+	break;
+    }
+}
+
+int KmersFileCreator::write_entry(char *motif, const std::vector<int> &values)
+{
+    if (!write_key(motif))
+	return -1;
+    write_attrs(values.data());
+    nentries++;
+    return 0;
+}
+
+int KmersFileCreator::write_entry(char *motif, int values[])
+{
+    if (!write_key(motif))
+	return -1;
+    write_attrs(values);
+    nentries++;
+    return 0;
+}
+
+int KmersFileCreator::write_tombstone(char *motif)
+{
+    if (!(flags & MOTIF_TABLE_DELTA))
+    {
+	fprintf(stderr, "KmersFileCreator: tombstones only go in delta tables\n");
+	return -1;
+    }
+    uint64_t n = nentries;
+    std::vector<int> none(attr_len.size());
+    if (write_entry(motif, none) < 0)
+	return -1;
+    if (tombstones.size() <= n / 64)
+	tombstones.resize(n / 64 + 1);
+    tombstones[n / 64] |= (uint64_t) 1 << (n % 64);
+    return 0;
+}
+
+/*
+ * Set motif to entry n's motif, in uppercase if fold is set. Packed
+ * keys always decode in uppercase.
+ */
+static void entry_motif(struct motif_table *tbl, unsigned long n, char *motif, int fold)
+{
+    int len = tbl->header.motif_len;
+    if (tbl->header.flags & MOTIF_TABLE_PACKED_KEYS)
+	decode_motif(get_key_at(tbl, n), len, motif);
+    else
     {
-	switch (attr_len[i])
+	memcpy(motif, get_motif_at(tbl, n), len);
+	if (fold)
+	    for (int i = 0; i < len; i++)
+		motif[i] = toupper((unsigned char) motif[i]);
+    }
+}
+
+static int write_from(KmersFileCreator &out, struct motif_table *tbl, unsigned long n, char *motif,
+		      std::vector<int> &values)
+{
+    for (int i = 0; i < tbl->header.num_attrs; i++)
+	values[i] = get_attr_value(tbl, n, i);
+    return out.write_entry(motif, values) == 0;
+}
+
+static int merge_tables(struct motif_table *base, struct motif_table *delta, char *out_file,
+			char **indexes, int nindexes)
+{
+    int flags = base->header.flags;
+    if (flags & (MOTIF_TABLE_CUCKOO | MOTIF_TABLE_ENCODED_KEYS | MOTIF_TABLE_DELTA))
+    {
+	fprintf(stderr, "%s is not a sorted table that can be read in order\n", base->mapped_file);
+	return 0;
+    }
+    if (!(delta->header.flags & MOTIF_TABLE_DELTA))
+    {
+	fprintf(stderr, "%s is not a delta table\n", delta->mapped_file);
+	return 0;
+    }
+    if (delta->header.motif_len != base->header.motif_len || delta->header.num_attrs != base->header.num_attrs)
+    {
+	fprintf(stderr, "%s does not match the motif length and attributes of %s\n",
+		delta->mapped_file, base->mapped_file);
+	return 0;
+    }
+
+    /*
+     * The output is in the base's order: case folded for packed keys,
+     * byte order for raw motifs, which a packed delta cannot supply.
+     */
+    int fold = (flags & MOTIF_TABLE_PACKED_KEYS) != 0;
+    if (!fold && (delta->header.flags & MOTIF_TABLE_PACKED_KEYS))
+    {
+	fprintf(stderr, "%s has packed keys, which do not keep the case of the raw motifs of %s\n",
+		delta->mapped_file, base->mapped_file);
+	return 0;
+    }
+
+    int motif_len = base->header.motif_len;
+    std::vector<int> attr_len(base->header.attr_len, base->header.attr_len + base->header.num_attrs);
+    KmersFileCreator out(base->header.magic, motif_len, base->header.pad_len, attr_len);
+    out.set_format_version(base->version);
+    out.set_packed_keys(flags & MOTIF_TABLE_PACKED_KEYS);
+    out.set_columnar_attrs(flags & MOTIF_TABLE_COLUMNAR);
+    out.set_bitpacked_attrs(flags & MOTIF_TABLE_BITPACKED);
+    out.set_dictionary_attrs(flags & MOTIF_TABLE_DICTIONARY);
+
+    int ok = 1;
+    for (int i = 0; i < nindexes; i++)
+    {
+	char *arg = indexes[i];
+	if (strcmp(arg, "eytzinger") == 0)
+	    ok = out.set_eytzinger_index(1) && ok;
+	else if (strcmp(arg, "stree") == 0)
+	    ok = out.set_stree_index(1) && ok;
+	else if (strcmp(arg, "mphf") == 0)
+	    ok = out.set_mphf_index(1) && ok;
+	else if (strcmp(arg, "pgm") == 0)
+	    ok = out.set_pgm_index(1) && ok;
+	else if (strncmp(arg, "bloom=", 6) == 0)
+	    ok = out.set_bloom_filter(atof(arg + 6)) && ok;
+	else
 	{
-	case 1:
-	    cv = (char) values[i];
-	    fwrite(&cv, 1, sizeof(char), fp);
-	    // printf("write char %d\n", cv);
-	    break;
+	    fprintf(stderr, "Unknown index type %s\n", arg);
+	    ok = 0;
+	}
+    }
+    if (!ok || !out.open_file(out_file) || out.write_file_header() < 0)
+	return 0;
 
-	case 2:
-	    sv = htons((short) values[i]);
-	    fwrite(&sv, 1, sizeof(short), fp);
-	    // printf("write short %d\n", sv);
-	    break;
+    std::vector<char> bm(motif_len + 1), dm(motif_len + 1);
+    std::vector<int> values(base->header.num_attrs);
+    unsigned long b = 0, d = 0;
+    unsigned long kept = 0, replaced = 0, added = 0, deleted = 0;
+    if (b < base->len)
+	entry_motif(base, b, &bm[0], fold);
+    if (d < delta->len)
+	entry_motif(delta, d, &dm[0], fold);
+    while (ok && (b < base->len || d < delta->len))
+    {
+	int cmp;
+	if (d == delta->len)
+	    cmp = -1;
+	else if (b == base->len)
+	    cmp = 1;
+	else
+	    cmp = memcmp(&bm[0], &dm[0], motif_len);
 
-	case 4:
-	    iv = htonl((int) values[i]);
-	    fwrite(&iv, 1, sizeof(int), fp);
-	    // printf("write int %d\n", iv);
-	    break;
+	if (cmp <= 0)
+	{
+	    if (cmp < 0)
+	    {
+		ok = write_from(out, base, b, &bm[0], values);
+		kept++;
+	    }
+	    if (++b < base->len)
+		entry_motif(base, b, &bm[0], fold);
+	}
+	if (cmp >= 0)
+	{
+	    if (is_tombstone(delta, d))
+		deleted += cmp == 0;
+	    else
+	    {
+		ok = ok && write_from(out, delta, d, &dm[0], values);
+		if (cmp == 0)
+		    replaced++;
+		else
+		    added++;
+	    }
+	    if (++d < delta->len)
+		entry_motif(delta, d, &dm[0], fold);
 	}
     }
-    if (padding)
-	fwrite(padding, 1, pad_len, fp);
-    return 0;
+
+    if (!out.close_file())
+	ok = 0;
+    fprintf(stderr, "%s: %lu kept, %lu replaced, %lu added, %lu deleted\n", out_file, kept, replaced, added, deleted);
+    return ok;
 }
 
+int compact_table(char *base_file, char *delta_file, char *out_file, char **indexes, int nindexes)
+{
+    struct motif_table base, delta;
+    if (!map_table(base_file, &base))
+	return 0;
+    if (!map_table(delta_file, &delta))
+    {
+	unmap_table(&base);
+	return 0;
+    }
+    int ok = merge_tables(&base, &delta, out_file, indexes, nindexes);
+    unmap_table(&base);
+    unmap_table(&delta);
+    return ok;
+}
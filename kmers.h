@@ -2,12 +2,41 @@
 #define _kmers_h
 
 #include "table.h"
+#include "multik.h"
+#include "shard.h"
+#include <pthread.h>
 
 #include <string>
 #include <vector>
+#include <map>
 
 typedef void (*hit_callback_t)(int offset, unsigned int ff_val, unsigned int sim_val);
 
+/*
+ * A hit found by Kmers::scan: the offset of the window in the
+ * query and the entry number of the matching motif in the table,
+ * or in shard shard of a sharded table, or in the delta table if
+ * shard is Kmers::DELTA_SHARD.
+ */
+struct motif_hit
+{
+    int offset;
+    long n;
+    int shard;
+};
+
+/*
+ * A hit found by KmersMulti::scan: as motif_hit, plus the table (and
+ * so the motif length) it was found in.
+ */
+struct multik_hit
+{
+    int offset;
+    int k;
+    int table;
+    long n;
+};
+
 class KmersFileCreator
 {
  public:
@@ -17,21 +46,210 @@ class KmersFileCreator
     int open_file(char *file);
     int close_file();
 
+    /*
+     * Store motifs as packed integer keys (see motif_key.h). Must be
+     * called before write_file_header.
+     */
+    int set_packed_keys(int on);
+
+    /*
+     * Build an Eytzinger search index sidecar when the file is closed.
+     * Requires packed keys.
+     */
+    int set_eytzinger_index(int on);
+
+    /*
+     * Build an S-tree (static 17-way B-tree) search index sidecar when
+     * the file is closed. Requires packed keys.
+     */
+    int set_stree_index(int on);
+
+    /*
+     * Write a blocked Bloom filter sidecar with the given false
+     * positive rate when the file is closed; 0 turns it off. Lookups
+     * check the filter before searching the table.
+     */
+    int set_bloom_filter(double fpr);
+
+    /*
+     * Build a minimal perfect hash index sidecar when the file is
+     * closed, for O(1) exact lookups.
+     */
+    int set_mphf_index(int on);
+
+    /*
+     * Build a learned (piecewise linear) index sidecar when the file is
+     * closed. Requires packed keys.
+     */
+    int set_pgm_index(int on);
+
+    /*
+     * Write a cuckoo hash table (see cuckoo.h) instead of a sorted one.
+     * Entries may then be written in any order; they are held in memory
+     * and placed when the file is closed. Must be called before
+     * write_file_header. Search indexes are not built for cuckoo tables.
+     */
+    int set_cuckoo_table(int on);
+
+    /*
+     * Write a version 1 (default) or version 2 table (see table.h).
+     * Version 2 tables hold native-endian values and carry their
+     * indexes and filters as sections of the table file rather than in
+     * sidecar files. Must be called before write_file_header.
+     */
+    int set_format_version(int version);
+
+    /*
+     * Store each attribute as its own column, apart from the keys (see
+     * MOTIF_TABLE_COLUMNAR in table.h), so that searches only read key
+     * bytes. Requires a version 2 table; not for cuckoo tables. The
+     * columns are held in memory and written when the file is closed.
+     * Must be called before write_file_header.
+     */
+    int set_columnar_attrs(int on);
+
+    /*
+     * Store the attribute columns bit-packed, each in just enough bits
+     * for the range of values written to it (see bitpack.h). Implies
+     * set_columnar_attrs. Must be called before write_file_header.
+     * Until the file is closed each column is buffered at 4 bytes per
+     * entry, so building needs 4 * num_attrs bytes of memory per entry
+     * however well the columns pack.
+     */
+    int set_bitpacked_attrs(int on);
+
+    /*
+     * Store each distinct tuple of attribute values once, in a
+     * dictionary, and only a bit-packed tuple number per entry. Suits
+     * tables where many motifs share the same attributes. Requires a
+     * version 2 table; not for cuckoo tables, nor with columnar
+     * attributes. Must be called before write_file_header.
+     */
+    int set_dictionary_attrs(int on);
+
+    /*
+     * Front code the keys in blocks (see frontcode.h) for a smaller
+     * table, at the cost of decoding a block per lookup. Requires a
+     * version 2 table; implies set_columnar_attrs unless the attributes
+     * are dictionary encoded. Only exact lookups are supported, so no
+     * search indexes are built. Must be called before write_file_header.
+     */
+    int set_front_coded_keys(int on);
+
+    /*
+     * Elias-Fano encode the packed keys (see eliasfano.h), in about
+     * 2 + log2(key range / entries) bits each. Otherwise as
+     * set_front_coded_keys. Requires packed keys.
+     */
+    int set_elias_fano_keys(int on);
+
+    /*
+     * Write a delta table (see MOTIF_TABLE_DELTA in table.h), holding
+     * changes to a base table: entries written to it add or replace
+     * the base's entries, and write_tombstone deletes them. Requires a
+     * version 2 table; not for cuckoo tables or encoded keys. Must be
+     * called before write_file_header.
+     */
+    int set_delta_table(int on);
+
     int write_file_header();
     int write_entry(char *motif, const std::vector<int> &values);
     int write_entry(char *motif, int values[]);
 
+    /*
+     * Write an entry to a delta table that deletes motif from the base.
+     * Entries and tombstones are written together in sorted order.
+     */
+    int write_tombstone(char *motif);
+
  private:
 
+    int write_key(char *motif);
+    int32_t attr_value(int i, int value);
+    void write_attrs(const int values[]);
+    void write_attr(int i, int value);
+    int write_columns();
+    int write_dictionary();
+    int write_tombstones();
+    int build_indexes();
+    int write_cuckoo_rows();
+    int write_encoded_keys();
+    int finish_v2_table();
+    int store_index(struct motif_table *tbl, const char *suffix, uint32_t magic,
+		    const void *data, size_t size);
+
+    enum { INDEX_EYTZINGER = 0x1, INDEX_STREE = 0x2, INDEX_MPHF = 0x4, INDEX_PGM = 0x8 };
+
+    int set_index(int index, int on, const char *name);
+    int write_index(struct motif_table *tbl, const char *suffix, uint32_t magic,
+		    int (*build)(struct motif_table *, void **, size_t *));
+
     int magic;
     int motif_len;
     int pad_len;
+    int flags;
+    int version;
+    struct motif_table_header_v2 v2_header;
 
     char *padding;
     FILE *fp;
+
+    /*
+     * Where entries go: fp, or for a cuckoo table or encoded keys a
+     * memory stream over rows_buf that is written out at close.
+     */
+    FILE *rows_fp;
+    char *rows_buf;
+    size_t rows_size;
+    /*
+     * For a columnar table, a memory stream per attribute column. For a
+     * bit-packed one the stream holds each value as an int32_t, and
+     * the range of the values is kept for packing them at close.
+     */
+    struct column
+    {
+	FILE *fp;
+	char *buf;
+	size_t size;
+	int32_t min;
+	int32_t max;
+    };
+    std::vector<column> columns;
+
+    /*
+     * For a dictionary-encoded table, the number of each distinct tuple
+     * of attribute values and the tuple number of each entry.
+     */
+    std::map<std::vector<int32_t>, int32_t> tuple_ids;
+    std::vector<int32_t> entry_tuples;
+
+    /*
+     * The number of entries written, and for a delta table the bitmap
+     * of those that are tombstones.
+     */
+    uint64_t nentries;
+    std::vector<uint64_t> tombstones;
+
+    int header_written;		/* write_file_header succeeded */
+
     std::vector<int> attr_len;
+    std::string file;
+    int indexes;
+    double bloom_fpr;
 };
 
+/*
+ * Merge the delta table delta_file into its base table base_file in one
+ * pass, writing out_file with the base's format version, key layout and
+ * attribute layout. The indexes (as for build_index: "eytzinger",
+ * "stree", "mphf", "pgm" or "bloom=FPR") are built for the output. The
+ * tables are merged in the output's order: a packed base's keys are
+ * case folded, so the delta's motifs are folded to match, while a raw
+ * base keeps its motifs' case and cannot take a packed delta, whose
+ * motifs have lost theirs. Returns 0 on error.
+ */
+int compact_table(char *base_file, char *delta_file, char *out_file, char **indexes, int nindexes);
+
 class Kmers
 {
  public:
@@ -43,13 +261,150 @@ class Kmers
     int write_file_header();
     int write_entry(char *motif, int value);
     
-    int open_data(char *file);
+    /*
+     * Map a table file, or open a shard manifest (see shard.h), whose
+     * shards are then mapped as lookups reach them. residency, if
+     * given, is a comma-separated list of residency options for the
+     * mappings (see parse_map_opts in table.h), such as "populate" or
+     * "willneed,random"; the default maps lazily.
+     */
+    int open_data(char *file, const char *residency = 0);
+
+    /*
+     * Seconds spent applying the residency options to the tables
+     * mapped so far.
+     */
+    double get_warmup_time();
+
+    /*
+     * Size of the pages holding the table (or the first mapped shard),
+     * which the "hugepages" residency option may make larger than the
+     * system page size; 0 if nothing is mapped.
+     */
+    long get_page_size();
 
-    int find_hit(char *motif, std::vector<int> &attrs);
+    /*
+     * The number of Kmers objects in the process sharing this one's
+     * table (see acquire_table in table.h), including this one.
+     */
+    int get_share_count() { return table_share_count(&mtable); }
 
-    int get_motif_len() { return mtable.header.motif_len; }
+    /*
+     * With the "numa" residency option, the number of NUMA nodes
+     * holding a replica of the table. Lookups read the replica on the
+     * calling thread's node.
+     */
+    int get_replica_count();
+
+    /*
+     * Overlay a delta table (see KmersFileCreator::set_delta_table) on
+     * the table opened by open_data. Lookups check the delta first; its
+     * entries replace the base's and its tombstones hide them. Hits
+     * from the delta are reported with shard DELTA_SHARD.
+     */
+    int open_delta(char *file);
+
+    enum { DELTA_SHARD = -1 };
+
+    /*
+     * Replace the table opened by open_data with file without pausing
+     * lookups. file is mapped and warmed up, with the residency options
+     * given to open_data, on a background thread, while lookups go on
+     * against the old table. The first lookup after it is ready
+     * switches to it, and the old table is then released on another
+     * thread, so no lookup is in flight on it and none waits for it to
+     * be unmapped. Entry numbers from a lookup are only good for
+     * get_attrs until the next lookup. Returns 0 if a reload is already
+     * under way or the table is sharded.
+     */
+    int reload(char *file);
+
+    /*
+     * Wait for a reload to finish, and switch to the new table. Returns
+     * 1 if the table was replaced, 0 if the new one could not be mapped
+     * or does not match the old one's motif length and attributes.
+     */
+    int wait_reload();
+
+    /*
+     * For a sharded table, keep at most max shards mapped, unmapping
+     * the least recently used; 0 (the default) keeps them all.
+     */
+    void set_max_mapped_shards(int max);
+
+    /*
+     * Look up motif, setting attrs to its attributes. Returns its
+     * entry number, or -1.
+     */
+    long find_hit(char *motif, std::vector<int> &attrs);
+
+    /*
+     * Look up count motifs at once, storing the entry number of each
+     * (or -1) in results, and for a sharded table the shard of each
+     * in shards.
+     */
+    void find_hits(char **motifs, int count, long *results, int *shards = 0);
+
+    /*
+     * Look up every motif_len window of seq, appending the hits to hits.
+     * Returns the number of hits found.
+     */
+    int scan(const char *seq, size_t len, std::vector<motif_hit> &hits);
+
+    /*
+     * Decode the attributes of table entry n.
+     */
+    void get_attrs(long n, std::vector<int> &attrs);
+    void get_attrs(int shard, long n, std::vector<int> &attrs);
+
+    int get_motif_len() { return sharded ? shard_set.motif_len : mtable.header.motif_len; }
+
+    /*
+     * Select the search for whole-table lookups: "auto", "binary",
+     * "eytzinger", "stree", "mphf", "cuckoo", "pgm", "frontcoded" or
+     * "eliasfano". Returns 0 if the table lacks the index.
+     */
+    int set_search_method(const char *method);
+
+    /*
+     * The search method in use, as resolved from the requested one.
+     */
+    const char *get_search_method()
+    {
+	return search_method_name(sharded ? get_shard_search_method(&shard_set) : mtable.search);
+    }
 
  private:
+    struct motif_table *table_for(int shard);
+    void find_sharded(char **motifs, const uint64_t *keys, int count, long *results, int *shards);
+    void overlay_delta(const long *delta, int count, long *results, int *shards);
+
+    /*
+     * Called at the start of each lookup, which is the only point
+     * where the table may change underneath get_attrs: a finished
+     * reload is swapped in, and the shards the last lookup used may
+     * be unmapped again.
+     */
+    void begin_lookup()
+    {
+	if (reloading && __atomic_load_n(&reload_done, __ATOMIC_ACQUIRE))
+	    finish_reload();
+	if (sharded)
+	    begin_shard_batch(&shard_set);
+	lookup_table = local_table();
+    }
+    int finish_reload();
+
+    void init_node_tables();
+    struct motif_table *local_table()
+    {
+	if (node_tables.empty())
+	    return &mtable;
+	size_t node = numa_node();
+	return node < node_tables.size() ? &node_tables[node] : &mtable;
+    }
+    static void *reload_main(void *arg);
+
     int magic;
     int motif_len;
     int pad_len;
@@ -57,7 +412,87 @@ class Kmers
     int num_attrs;
 
     struct motif_table mtable;
+    std::vector<struct motif_table> node_tables;	/* per NUMA node */
+    struct motif_table *lookup_table;	/* local_table for the current lookup */
+
+    int map_opts;
+    int sharded;
+    struct motif_shard_set shard_set;
+
+    int has_delta;
+    struct motif_table delta_table;
+
+    /*
+     * A reload in progress: the background thread fills in reload_table
+     * and reload_ok, then sets reload_done.
+     */
+    int reloading;
+    pthread_t reload_thread;
+    std::string reload_file;
+    struct motif_table reload_table;
+    int reload_ok;
+    int reload_done;
+
+    /*
+     * Scratch space for scan, kept to avoid reallocating per query.
+     */
+    std::vector<unsigned char> scan_codes;
+    std::vector<uint64_t> scan_keys;
+    std::vector<char *> scan_motifs;
+    std::vector<long> scan_results;
+    std::vector<int> scan_shards;
+    std::vector<long> delta_results;
+
+    /*
+     * Scratch space for routing lookups to shards.
+     */
+    std::vector<int> shard_order;
+    std::vector<int> shard_start;
+    std::vector<char *> shard_motifs;
+    std::vector<uint64_t> shard_keys;
+    std::vector<long> shard_results;
 };
 
+/*
+ * The tables of a multi-k file (see multik.h), searched together.
+ */
+class KmersMulti
+{
+ public:
+    KmersMulti();
+    ~KmersMulti();
+
+    /*
+     * Map a multi-k file, with residency options as for Kmers::open_data.
+     */
+    int open_data(char *file, const char *residency = 0);
+
+    double get_warmup_time() { return mk.warmup_seconds; }
+    long get_page_size() { return mk.page_size; }
+
+    int num_tables() { return mk.ntables; }
+    int get_motif_len(int t) { return mk.tables[t].header.motif_len; }
+
+    /*
+     * Look up every window of seq for each table's motif length,
+     * appending the hits to hits ordered by offset, then by motif
+     * length. The query is translated to residue codes once for all
+     * the tables. Returns the number of hits found.
+     */
+    int scan(const char *seq, size_t len, std::vector<multik_hit> &hits);
+
+    /*
+     * Decode the attributes of entry n of table t.
+     */
+    void get_attrs(int t, long n, std::vector<int> &attrs);
+
+ private:
+    struct motif_multik mk;
+
+    std::vector<unsigned char> scan_codes;
+    std::vector<uint64_t> scan_keys;
+    std::vector<char *> scan_motifs;
+    std::vector<std::vector<long> > scan_results;
+};
 
 #endif /* _kmers_h */
@@ -15,6 +15,10 @@
  *
  * This program takes command arguments as follows:
  *
+ *    Optionally -d, to write a version 2 table with dictionary-encoded
+ *    attributes. Readers older than the version 2 format misread such
+ *    a table, so the default is a version 1 table.
+ *
  *    Figfam-function data file. Contains list of file names in sorted order that
  *    source the figfam-function data.
  *
@@ -28,6 +32,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <vector>
 #include <list>
@@ -259,7 +264,7 @@ void DataReader::write_values(int target[])
 
 typedef std::vector<DataReader *> reader_list;
 
-void read_files(reader_list &readers, int kmer, const std::string &outfile)
+void read_files(reader_list &readers, int kmer, const std::string &outfile, int dictionary)
 {
     std::vector<int> attr_len;
     attr_len.push_back(4);
@@ -268,6 +273,16 @@ void read_files(reader_list &readers, int kmer, const std::string &outfile)
     attr_len.push_back(4);
     KmersFileCreator creator(0xfeedface, kmer, 0, attr_len);
 
+    /*
+     * Millions of kmers share a few hundred thousand attribute tuples,
+     * so store each tuple once.
+     */
+    if (dictionary)
+    {
+	creator.set_format_version(2);
+	creator.set_dictionary_attrs(1);
+    }
+
     creator.open_file((char *) outfile.c_str());
     creator.write_file_header();
     
@@ -312,9 +327,16 @@ void read_files(reader_list &readers, int kmer, const std::string &outfile)
 
 int main(int argc, char **argv)
 {
+    int dictionary = 0;
+    if (argc > 1 && strcmp(argv[1], "-d") == 0)
+    {
+	dictionary = 1;
+	argv++;
+	argc--;
+    }
     if (argc != 6)
     {
-	fprintf(stderr, "Usage: %s ff-funcdata ff-ffdata phylo-data kmer-size output-file\n", argv[0]);
+	fprintf(stderr, "Usage: %s [-d] ff-funcdata ff-ffdata phylo-data kmer-size output-file\n", argv[0]);
 	exit(1);
     }
 
@@ -343,6 +365,6 @@ int main(int argc, char **argv)
     readers.push_back(&ffdata);
     readers.push_back(&phylodata);
 
-    read_files(readers, kmer, outfile);
+    read_files(readers, kmer, outfile, dictionary);
 }
  
@@ -0,0 +1,80 @@
+
+#include "motif_key.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+int encode_motif(const char *motif, int len, uint64_t *key)
+{
+    uint64_t k = 0;
+    int i;
+    for (i = 0; i < len; i++)
+    {
+	unsigned int code = residue_code(motif[i]);
+	if (code == 0)
+	    return 0;
+	k = (k << RESIDUE_BITS) | code;
+    }
+    *key = k;
+    return 1;
+}
+
+void decode_motif(uint64_t key, int len, char *motif)
+{
+    int i;
+    for (i = len - 1; i >= 0; i--)
+    {
+	motif[i] = 'A' + (int) (key & RESIDUE_MASK) - 1;
+	key >>= RESIDUE_BITS;
+    }
+}
+
+void encode_residues(const char *seq, size_t len, unsigned char *codes)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    /*
+     * Same arithmetic as residue_code: fold case, rebase so 'a' is 1,
+     * and zero anything that did not land in 1..26.
+     */
+    const __m128i fold = _mm_set1_epi8(0x20);
+    const __m128i base = _mm_set1_epi8('a' - 1);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i top = _mm_set1_epi8(25);
+    for (; i + 16 <= len; i += 16)
+    {
+	__m128i c = _mm_loadu_si128((const __m128i *) (seq + i));
+	__m128i x = _mm_sub_epi8(_mm_or_si128(c, fold), base);
+	__m128i x1 = _mm_sub_epi8(x, one);
+	__m128i valid = _mm_cmpeq_epi8(_mm_min_epu8(x1, top), x1);
+	_mm_storeu_si128((__m128i *) (codes + i), _mm_and_si128(x, valid));
+    }
+#endif
+
+    for (; i < len; i++)
+	codes[i] = residue_code(seq[i]);
+}
+
+size_t encode_windows(const unsigned char *codes, size_t len, int motif_len, uint64_t *keys)
+{
+    if (len < (size_t) motif_len)
+	return 0;
+
+    uint64_t mask = (motif_len * RESIDUE_BITS >= 64) ? ~(uint64_t) 0 :
+	((uint64_t) 1 << (motif_len * RESIDUE_BITS)) - 1;
+    uint64_t key = 0;
+    int run = 0;		/* number of valid residues ending at i */
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+	unsigned int c = codes[i];
+	key = ((key << RESIDUE_BITS) | c) & mask;
+	run = c ? run + 1 : 0;
+	if (i + 1 >= (size_t) motif_len)
+	    keys[i + 1 - motif_len] = (run >= motif_len) ? key : 0;
+    }
+    return len - motif_len + 1;
+}
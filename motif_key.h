@@ -0,0 +1,66 @@
+#ifndef _motif_key_h
+#define _motif_key_h
+
+/*
+ * Packed integer motif keys.
+ *
+ * Each residue is coded in 5 bits as its position in the alphabet
+ * (A=1 .. Z=26, case folded). Code 0 is never a valid residue, so
+ * a zero key never matches a real motif.
+ *
+ * A motif of up to MAX_PACKED_MOTIF_LEN residues packs into a uint64_t
+ * with the first residue in the most significant position. Packed keys
+ * therefore sort in the same order as the (uppercase) motif strings and
+ * a sorted table stays sorted when its keys are packed.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RESIDUE_BITS 5
+#define RESIDUE_MASK ((1 << RESIDUE_BITS) - 1)
+#define MAX_PACKED_MOTIF_LEN 12
+
+/*
+ * Return the 5-bit code for residue c, or 0 if c is not a letter.
+ */
+inline unsigned int residue_code(unsigned char c)
+{
+    unsigned int x = (unsigned int) (c | 0x20) - 'a';
+    return x < 26 ? x + 1 : 0;
+}
+
+/*
+ * Pack the first len residues of motif into *key. Returns 0 if the
+ * motif contains a character that has no residue code.
+ */
+int encode_motif(const char *motif, int len, uint64_t *key);
+
+/*
+ * Unpack key into len uppercase characters at motif (not null terminated).
+ */
+void decode_motif(uint64_t key, int len, char *motif);
+
+/*
+ * Translate len characters of seq into residue codes, 16 at a time
+ * where SSE2 is available. Non-residues translate to 0.
+ */
+void encode_residues(const char *seq, size_t len, unsigned char *codes);
+
+/*
+ * Slide a motif_len window along len residue codes, setting keys[i]
+ * to the packed key of the window starting at i. Windows that contain
+ * a non-residue get key 0. keys must have room for len - motif_len + 1
+ * values; the number of windows is returned.
+ */
+size_t encode_windows(const unsigned char *codes, size_t len, int motif_len, uint64_t *keys);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _motif_key_h */
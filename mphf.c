@@ -0,0 +1,304 @@
+
+#include "mphf.h"
+#include "hash.h"
+#include "table.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Bits per remaining key at each level. Larger values waste space but
+ * let more keys settle at the first level.
+ */
+#define GAMMA 2.0
+
+#define ROUND64(x) (((x) + 63) & ~(size_t) 63)
+
+static uint64_t level_hash(uint64_t h, int level)
+{
+    return level == 0 ? h : hash_seed(h, level + 0x100);
+}
+
+static uint16_t fingerprint(uint64_t h)
+{
+    return (uint16_t) (hash_seed(h, 0x200) >> 48);
+}
+
+static uint64_t rank(const struct mphf_index *idx, uint64_t pos)
+{
+    uint64_t r = idx->ranks[pos >> 9];
+    uint64_t w = (pos >> 9) << 3;
+    for (; w < (pos >> 6); w++)
+	r += __builtin_popcountll(idx->bits[w]);
+    return r + __builtin_popcountll(idx->bits[w] & (((uint64_t) 1 << (pos & 63)) - 1));
+}
+
+static int get_bit(const uint64_t *bits, uint64_t pos)
+{
+    return (bits[pos >> 6] >> (pos & 63)) & 1;
+}
+
+static void set_bit(uint64_t *bits, uint64_t pos)
+{
+    bits[pos >> 6] |= (uint64_t) 1 << (pos & 63);
+}
+
+/*
+ * Offsets of the parts of a serialized index.
+ */
+struct layout
+{
+    size_t bits;
+    size_t ranks;
+    size_t fingerprints;
+    size_t entries;
+    size_t fallback;
+    size_t size;
+};
+
+static void compute_layout(const struct mphf_header *hdr, struct layout *l)
+{
+    uint64_t nblocks = (hdr->nwords + 7) / 8 + 1;
+    l->bits = ROUND64(sizeof(*hdr));
+    l->ranks = ROUND64(l->bits + hdr->nwords * sizeof(uint64_t));
+    l->fingerprints = ROUND64(l->ranks + nblocks * sizeof(uint64_t));
+    l->entries = ROUND64(l->fingerprints + hdr->count * sizeof(uint16_t));
+    l->fallback = ROUND64(l->entries + hdr->count * sizeof(uint32_t));
+    l->size = l->fallback + hdr->nfallback * sizeof(struct mphf_fallback);
+}
+
+static int fallback_cmp(const void *a, const void *b)
+{
+    uint64_t ha = ((const struct mphf_fallback *) a)->hash;
+    uint64_t hb = ((const struct mphf_fallback *) b)->hash;
+    return ha < hb ? -1 : ha > hb;
+}
+
+int mphf_build(struct motif_table *tbl, void **data, size_t *size)
+{
+    if (is_large_table(tbl))
+    {
+	fprintf(stderr, "mphf_build: %s has too many entries\n", tbl->mapped_file);
+	return 0;
+    }
+
+    uint64_t count = tbl->len;
+    uint64_t *hashes = (uint64_t *) malloc((count + 1) * sizeof(uint64_t));
+    uint32_t *remaining = (uint32_t *) malloc((count + 1) * sizeof(uint32_t));
+    uint64_t *placed_at = (uint64_t *) malloc((count + 1) * sizeof(uint64_t));
+    if (hashes == 0 || remaining == 0 || placed_at == 0)
+    {
+	fprintf(stderr, "mphf_build: cannot allocate memory for %lu keys\n", tbl->len);
+	free(hashes);
+	free(remaining);
+	free(placed_at);
+	return 0;
+    }
+
+    uint64_t n;
+    for (n = 0; n < count; n++)
+    {
+	hashes[n] = entry_hash(tbl, n);
+	remaining[n] = n;
+	placed_at[n] = UINT64_MAX;
+    }
+
+    /*
+     * Settle keys level by level. The level bits are accumulated in one
+     * growing array; collide marks positions hit more than once.
+     */
+    struct mphf_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.count = count;
+
+    uint64_t *bits = 0;
+    uint64_t nwords = 0;
+    uint64_t nremaining = count;
+    int level;
+    for (level = 0; level < MPHF_MAX_LEVELS && nremaining > 0; level++)
+    {
+	uint64_t lwords = ((uint64_t) (nremaining * GAMMA) + 63) / 64;
+	if (lwords < 1)
+	    lwords = 1;
+	uint64_t lbits = lwords * 64;
+
+	bits = (uint64_t *) realloc(bits, (nwords + lwords) * sizeof(uint64_t));
+	uint64_t *collide = (uint64_t *) calloc(lwords, sizeof(uint64_t));
+	if (bits == 0 || collide == 0)
+	{
+	    fprintf(stderr, "mphf_build: cannot allocate level %d\n", level);
+	    free(bits);
+	    free(collide);
+	    free(hashes);
+	    free(remaining);
+	    free(placed_at);
+	    return 0;
+	}
+	uint64_t *lv = bits + nwords;
+	memset(lv, 0, lwords * sizeof(uint64_t));
+
+	uint64_t i;
+	for (i = 0; i < nremaining; i++)
+	{
+	    uint64_t p = hash_range(level_hash(hashes[remaining[i]], level), lbits);
+	    if (get_bit(lv, p))
+		set_bit(collide, p);
+	    else
+		set_bit(lv, p);
+	}
+	for (i = 0; i < lwords; i++)
+	    lv[i] &= ~collide[i];
+
+	uint64_t left = 0;
+	for (i = 0; i < nremaining; i++)
+	{
+	    uint32_t e = remaining[i];
+	    uint64_t p = hash_range(level_hash(hashes[e], level), lbits);
+	    if (get_bit(lv, p))
+		placed_at[e] = nwords * 64 + p;
+	    else
+		remaining[left++] = e;
+	}
+	free(collide);
+
+	hdr.level_words[level] = lwords;
+	nwords += lwords;
+	nremaining = left;
+    }
+    hdr.nlevels = level;
+    hdr.nwords = nwords;
+    hdr.nfallback = nremaining;
+
+    struct layout l;
+    compute_layout(&hdr, &l);
+    char *buf = (char *) calloc(l.size, 1);
+    if (buf == 0)
+    {
+	fprintf(stderr, "mphf_build: cannot allocate %zu bytes\n", l.size);
+	free(bits);
+	free(hashes);
+	free(remaining);
+	free(placed_at);
+	return 0;
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    if (nwords)
+	memcpy(buf + l.bits, bits, nwords * sizeof(uint64_t));
+    free(bits);
+
+    uint64_t *ranks = (uint64_t *) (buf + l.ranks);
+    const uint64_t *b = (const uint64_t *) (buf + l.bits);
+    uint64_t total = 0;
+    uint64_t w;
+    for (w = 0; w < nwords; w++)
+    {
+	if ((w & 7) == 0)
+	    ranks[w >> 3] = total;
+	total += __builtin_popcountll(b[w]);
+    }
+    ranks[(nwords + 7) / 8] = total;
+
+    struct mphf_index idx;
+    mphf_load(&idx, buf, l.size);
+    uint16_t *fps = (uint16_t *) (buf + l.fingerprints);
+    uint32_t *entries = (uint32_t *) (buf + l.entries);
+    struct mphf_fallback *fb = (struct mphf_fallback *) (buf + l.fallback);
+    uint64_t nfb = 0;
+    for (n = 0; n < count; n++)
+    {
+	if (placed_at[n] == UINT64_MAX)
+	{
+	    fb[nfb].hash = hashes[n];
+	    fb[nfb].entry = n;
+	    nfb++;
+	    continue;
+	}
+	uint64_t slot = rank(&idx, placed_at[n]);
+	fps[slot] = fingerprint(hashes[n]);
+	entries[slot] = n;
+    }
+    qsort(fb, nfb, sizeof(*fb), fallback_cmp);
+
+    free(hashes);
+    free(remaining);
+    free(placed_at);
+
+    *data = buf;
+    *size = l.size;
+    return 1;
+}
+
+int mphf_load(struct mphf_index *idx, const void *data, size_t size)
+{
+    const struct mphf_header *hdr = (const struct mphf_header *) data;
+    struct layout l;
+    if (size < sizeof(*hdr) || hdr->nlevels > MPHF_MAX_LEVELS)
+    {
+	fprintf(stderr, "mphf_load: index has invalid header\n");
+	return 0;
+    }
+    compute_layout(hdr, &l);
+    if (size != l.size)
+    {
+	fprintf(stderr, "mphf_load: index has invalid size %zu\n", size);
+	return 0;
+    }
+
+    const char *base = (const char *) data;
+    memset(idx, 0, sizeof(*idx));
+    idx->count = hdr->count;
+    idx->nfallback = hdr->nfallback;
+    idx->nlevels = hdr->nlevels;
+    uint64_t start = 0;
+    int i;
+    for (i = 0; i < idx->nlevels; i++)
+    {
+	idx->level_start[i] = start;
+	idx->level_bits[i] = hdr->level_words[i] * 64;
+	start += idx->level_bits[i];
+    }
+    idx->bits = (const uint64_t *) (base + l.bits);
+    idx->ranks = (const uint64_t *) (base + l.ranks);
+    idx->fingerprints = (const uint16_t *) (base + l.fingerprints);
+    idx->entries = (const uint32_t *) (base + l.entries);
+    idx->fallback = (const struct mphf_fallback *) (base + l.fallback);
+    return 1;
+}
+
+const uint64_t *mphf_first_probe(const struct mphf_index *idx, uint64_t h)
+{
+    return idx->bits + (hash_range(h, idx->level_bits[0]) >> 6);
+}
+
+long mphf_lookup(const struct mphf_index *idx, uint64_t h)
+{
+    int level;
+    for (level = 0; level < idx->nlevels; level++)
+    {
+	uint64_t p = idx->level_start[level] +
+	    hash_range(level_hash(h, level), idx->level_bits[level]);
+	if (get_bit(idx->bits, p))
+	{
+	    uint64_t slot = rank(idx, p);
+	    if (idx->fingerprints[slot] != fingerprint(h))
+		return -1;
+	    return idx->entries[slot];
+	}
+    }
+
+    /*
+     * Not settled at any level, so it can only be in the fallback list.
+     */
+    uint64_t beg = 0;
+    uint64_t end = idx->nfallback;
+    while (beg < end)
+    {
+	uint64_t mid = (beg + end) / 2;
+	if (idx->fallback[mid].hash < h)
+	    beg = mid + 1;
+	else
+	    end = mid;
+    }
+    if (beg < idx->nfallback && idx->fallback[beg].hash == h)
+	return (long) idx->fallback[beg].entry;
+    return -1;
+}
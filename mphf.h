@@ -0,0 +1,88 @@
+#ifndef _mphf_h
+#define _mphf_h
+
+/*
+ * Minimal perfect hash index mapping a table's keys to entry numbers.
+ *
+ * The hash function is built BBHash style from a cascade of bit arrays.
+ * At each level every remaining key hashes to a bit; the keys that had
+ * a bit to themselves keep it, and the rest move on to the next, smaller
+ * level. A key's slot is the rank of its bit over all levels, so the N
+ * keys land in slots 0 .. N-1. Each slot records a 16-bit fingerprint
+ * of the key's hash and the key's entry number in the table; keys left
+ * over after the last level go in a small sorted fallback list.
+ *
+ * A lookup costs a bit probe per level visited (usually one), a rank
+ * sample and the slot. Keys that are not in the table mostly fail the
+ * fingerprint; the rest must be checked against the table entry.
+ *
+ * The serialized index is an mphf_header followed by the level bits,
+ * the rank samples, the fingerprints, the entries and the fallback
+ * list, each starting on a 64-byte boundary.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MPHF_MAGIC 0x4d504846	/* "MPHF" */
+#define MPHF_SUFFIX ".mphf"
+
+#define MPHF_MAX_LEVELS 32
+
+struct motif_table;
+
+struct mphf_header
+{
+    uint64_t count;
+    uint64_t nfallback;
+    uint64_t nwords;		/* total words of level bits */
+    uint32_t nlevels;
+    uint32_t reserved0;
+    uint64_t level_words[MPHF_MAX_LEVELS];
+    uint64_t reserved[4];
+};
+
+struct mphf_fallback
+{
+    uint64_t hash;
+    uint64_t entry;
+};
+
+struct mphf_index
+{
+    uint64_t count;
+    uint64_t nfallback;
+    int nlevels;
+    uint64_t level_start[MPHF_MAX_LEVELS];	/* in bits */
+    uint64_t level_bits[MPHF_MAX_LEVELS];
+    const uint64_t *bits;
+    const uint64_t *ranks;	/* set bits before each 512-bit block */
+    const uint16_t *fingerprints;
+    const uint32_t *entries;
+    const struct mphf_fallback *fallback;
+};
+
+int mphf_build(struct motif_table *tbl, void **data, size_t *size);
+int mphf_load(struct mphf_index *idx, const void *data, size_t size);
+
+/*
+ * Return the entry number that the key with hash h (see hash.h) would
+ * have if it is in the table, or -1 if it certainly is not.
+ */
+long mphf_lookup(const struct mphf_index *idx, uint64_t h);
+
+/*
+ * Address of the level 0 bit for hash h, for prefetching.
+ */
+const uint64_t *mphf_first_probe(const struct mphf_index *idx, uint64_t h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _mphf_h */
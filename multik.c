@@ -0,0 +1,202 @@
+
+#include "multik.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+struct k_table
+{
+    char *file;
+    int motif_len;
+    uint64_t size;
+};
+
+static int compare_k(const void *a, const void *b)
+{
+    return ((const struct k_table *) a)->motif_len - ((const struct k_table *) b)->motif_len;
+}
+
+static int copy_table(FILE *out, const char *file, uint64_t size)
+{
+    FILE *in = fopen(file, "r");
+    if (in == 0)
+    {
+	fprintf(stderr, "write_multik_file: cannot open %s: %s\n", file, strerror(errno));
+	return 0;
+    }
+    char buf[65536];
+    uint64_t done = 0;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    {
+	if (fwrite(buf, 1, n, out) != n)
+	    break;
+	done += n;
+    }
+    fclose(in);
+    if (done != size)
+    {
+	fprintf(stderr, "write_multik_file: copying %s failed\n", file);
+	return 0;
+    }
+    return 1;
+}
+
+int write_multik_file(const char *file, char **tables, int ntables)
+{
+    if (ntables < 1 || ntables > MOTIF_MAX_K_TABLES)
+    {
+	fprintf(stderr, "write_multik_file: cannot bundle %d tables (max %d)\n", ntables, MOTIF_MAX_K_TABLES);
+	return 0;
+    }
+
+    struct k_table k[MOTIF_MAX_K_TABLES];
+    int i;
+    for (i = 0; i < ntables; i++)
+    {
+	struct motif_table tbl;
+	if (!map_table(tables[i], &tbl))
+	    return 0;
+	int ok = tbl.version >= 2;
+	if (!ok)
+	    fprintf(stderr, "write_multik_file: %s is not a version 2 table\n", tables[i]);
+	k[i].file = tables[i];
+	k[i].motif_len = tbl.header.motif_len;
+	k[i].size = tbl.mapped_size;
+	unmap_table(&tbl);
+	if (!ok)
+	    return 0;
+    }
+    qsort(k, ntables, sizeof(k[0]), compare_k);
+
+    struct motif_multik_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.signature, MOTIF_MULTIK_SIGNATURE, sizeof(hdr.signature));
+    hdr.version = 1;
+    hdr.ntables = ntables;
+    uint64_t offset = MOTIF_MULTIK_ALIGN;
+    for (i = 0; i < ntables; i++)
+    {
+	if (i && k[i].motif_len == k[i - 1].motif_len)
+	{
+	    fprintf(stderr, "write_multik_file: %s and %s both have motif length %d\n",
+		    k[i - 1].file, k[i].file, k[i].motif_len);
+	    return 0;
+	}
+	hdr.tables[i].motif_len = k[i].motif_len;
+	hdr.tables[i].offset = offset;
+	hdr.tables[i].size = k[i].size;
+	offset += (k[i].size + MOTIF_MULTIK_ALIGN - 1) & ~(uint64_t) (MOTIF_MULTIK_ALIGN - 1);
+    }
+
+    FILE *out = fopen(file, "w");
+    if (out == 0)
+    {
+	fprintf(stderr, "write_multik_file: cannot open %s: %s\n", file, strerror(errno));
+	return 0;
+    }
+    int ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1;
+    for (i = 0; ok && i < ntables; i++)
+    {
+	ok = fseek(out, hdr.tables[i].offset, SEEK_SET) == 0 &&
+	    copy_table(out, k[i].file, k[i].size);
+    }
+    if (fclose(out) != 0)
+	ok = 0;
+    if (!ok)
+	fprintf(stderr, "write_multik_file: writing %s failed\n", file);
+    return ok;
+}
+
+int is_multik_file(const char *file)
+{
+    char sig[8];
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+	return 0;
+    int ok = read(fd, sig, sizeof(sig)) == sizeof(sig) &&
+	memcmp(sig, MOTIF_MULTIK_SIGNATURE, sizeof(sig)) == 0;
+    close(fd);
+    return ok;
+}
+
+int map_multik(const char *file, struct motif_multik *mk, int opts)
+{
+    memset(mk, 0, sizeof(*mk));
+    mk->mapped_fd = -1;
+    strncpy(mk->mapped_file, file, sizeof(mk->mapped_file) - 1);
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+    {
+	fprintf(stderr, "Error opening %s: %s\n", file, strerror(errno));
+	return 0;
+    }
+    struct stat s;
+    if (fstat(fd, &s) != 0 || (size_t) s.st_size < sizeof(struct motif_multik_header))
+    {
+	fprintf(stderr, "%s: not a multi-k table file\n", file);
+	close(fd);
+	return 0;
+    }
+    void *ptr = map_resident(fd, s.st_size, &opts, file, &mk->warmup_seconds, &mk->page_size);
+    if (ptr == MAP_FAILED)
+    {
+	fprintf(stderr, "Error mapping %s: %s\n", file, strerror(errno));
+	close(fd);
+	return 0;
+    }
+    mk->mapped_fd = fd;
+    mk->map_opts = opts;
+    mk->mapped_address = ptr;
+    mk->mapped_size = s.st_size;
+
+    const struct motif_multik_header *hdr = (const struct motif_multik_header *) ptr;
+    if (memcmp(hdr->signature, MOTIF_MULTIK_SIGNATURE, sizeof(hdr->signature)) != 0 ||
+	hdr->version != 1 || hdr->ntables > MOTIF_MAX_K_TABLES)
+    {
+	fprintf(stderr, "%s: not a multi-k table file\n", file);
+	unmap_multik(mk);
+	return 0;
+    }
+
+    uint32_t i;
+    for (i = 0; i < hdr->ntables; i++)
+    {
+	const struct motif_multik_entry *e = &hdr->tables[i];
+	char name[1100];
+	snprintf(name, sizeof(name), "%s[k=%u]", file, e->motif_len);
+	if (e->offset % MOTIF_MULTIK_ALIGN || e->offset > mk->mapped_size ||
+	    e->size > mk->mapped_size - e->offset ||
+	    !map_table_image(&mk->tables[i], name, (char *) ptr + e->offset, e->size))
+	{
+	    fprintf(stderr, "%s: invalid table %u\n", file, i);
+	    unmap_multik(mk);
+	    return 0;
+	}
+	mk->ntables++;
+    }
+    if (opts)
+	fprintf(stderr, "%s: warm-up took %.3f s, %zu KiB pages\n", file, mk->warmup_seconds,
+		mk->page_size >> 10);
+    return 1;
+}
+
+void unmap_multik(struct motif_multik *mk)
+{
+    int i;
+    for (i = 0; i < mk->ntables; i++)
+	unmap_table(&mk->tables[i]);
+    mk->ntables = 0;
+    if (mk->mapped_fd >= 0)
+    {
+	unmap_resident(mk->mapped_address, mk->mapped_size, mk->map_opts);
+	close(mk->mapped_fd);
+    }
+    mk->mapped_fd = -1;
+    mk->mapped_address = 0;
+}
@@ -0,0 +1,74 @@
+#ifndef _multik_h
+#define _multik_h
+
+/*
+ * A file holding version 2 tables for several motif lengths.
+ *
+ * The file starts with a motif_multik_header listing the tables, each a
+ * complete version 2 table file image starting on a page boundary, in
+ * increasing order of motif length. The whole file is mapped once, and
+ * each table is set up over its part of the mapping.
+ */
+
+#include "table.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOTIF_MULTIK_SIGNATURE "MOTIFMK1"
+#define MOTIF_MAX_K_TABLES 32
+#define MOTIF_MULTIK_ALIGN 4096
+
+struct motif_multik_entry
+{
+    uint32_t motif_len;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct motif_multik_header
+{
+    char signature[8];
+    uint32_t version;
+    uint32_t ntables;
+    struct motif_multik_entry tables[MOTIF_MAX_K_TABLES];
+    uint64_t reserved[6];
+};
+
+struct motif_multik
+{
+    char mapped_file[1024];
+    int mapped_fd;
+    void *mapped_address;
+    size_t mapped_size;
+    double warmup_seconds;
+    int map_opts;
+    size_t page_size;
+    int ntables;
+    struct motif_table tables[MOTIF_MAX_K_TABLES];
+};
+
+/*
+ * Write the version 2 table files in tables, which must have distinct
+ * motif lengths, into one multi-k file. Returns 0 on error.
+ */
+int write_multik_file(const char *file, char **tables, int ntables);
+
+/*
+ * Return 1 if file is a multi-k file.
+ */
+int is_multik_file(const char *file);
+
+/*
+ * Map a multi-k file with the MOTIF_MAP_* residency options opts.
+ */
+int map_multik(const char *file, struct motif_multik *mk, int opts);
+void unmap_multik(struct motif_multik *mk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _multik_h */
@@ -0,0 +1,276 @@
+
+#include "pgm.h"
+#include "table.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define ROUND64(x) (((x) + 63) & ~(size_t) 63)
+
+/*
+ * Extra entries searched on each side of a prediction, to cover
+ * rounding in the floating point model.
+ */
+#define SLACK 2
+
+/*
+ * Greedy piecewise linear fit. Each segment keeps the range of slopes
+ * [lo, hi] that predict every point added so far to within eps, and is
+ * closed when a point would make the range empty. Slopes are kept
+ * non-negative so that predictions never decrease within a segment.
+ */
+struct fitter
+{
+    int eps;
+    struct pgm_segment *segs;
+    uint64_t nsegs;
+    uint64_t cap;
+    uint64_t x0;
+    int64_t y0;
+    double lo;
+    double hi;
+    int open;
+};
+
+static int fit_close(struct fitter *f)
+{
+    if (!f->open)
+	return 1;
+    if (f->nsegs == f->cap)
+    {
+	f->cap = f->cap ? 2 * f->cap : 1024;
+	f->segs = (struct pgm_segment *) realloc(f->segs, f->cap * sizeof(*f->segs));
+	if (f->segs == 0)
+	    return 0;
+    }
+    struct pgm_segment *s = &f->segs[f->nsegs++];
+    s->key = f->x0;
+    s->intercept = f->y0;
+    s->slope = isinf(f->hi) ? 0 : (f->lo + f->hi) / 2;
+    f->open = 0;
+    return 1;
+}
+
+static int fit_point(struct fitter *f, uint64_t x, int64_t y)
+{
+    if (f->open)
+    {
+	double dx = (double) (x - f->x0);
+	double dy = (double) (y - f->y0);
+	if (dx == 0)
+	{
+	    if (dy <= f->eps)
+		return 1;
+	}
+	else
+	{
+	    double l = (dy - f->eps) / dx;
+	    double h = (dy + f->eps) / dx;
+	    if (l <= f->hi && h >= f->lo)
+	    {
+		if (l > f->lo)
+		    f->lo = l;
+		if (h < f->hi)
+		    f->hi = h;
+		return 1;
+	    }
+	}
+	if (!fit_close(f))
+	    return 0;
+    }
+    f->x0 = x;
+    f->y0 = y;
+    f->lo = 0;
+    f->hi = INFINITY;
+    f->open = 1;
+    return 1;
+}
+
+/*
+ * Predicted position of key in segment i of a level of n segments over
+ * count positions. Keys past the segment's last one are held to the
+ * next segment's start.
+ */
+static int64_t predict(const struct pgm_segment *segs, uint64_t n, uint64_t i,
+		       uint64_t count, uint64_t key)
+{
+    const struct pgm_segment *s = &segs[i];
+    if (key <= s->key)
+	return s->intercept;
+    int64_t p = s->intercept + (int64_t) (s->slope * (double) (key - s->key));
+    int64_t limit = i + 1 < n ? segs[i + 1].intercept : (int64_t) count - 1;
+    return p < limit ? p : limit;
+}
+
+static void window(int64_t p, int eps, uint64_t count, uint64_t *lo, uint64_t *hi)
+{
+    int64_t l = p - eps - SLACK;
+    int64_t h = p + eps + SLACK + 1;
+    *lo = l < 0 ? 0 : l;
+    *hi = h > (int64_t) count ? count : h;
+}
+
+int pgm_build(struct motif_table *tbl, void **data, size_t *size)
+{
+    if (!(tbl->header.flags & MOTIF_TABLE_PACKED_KEYS))
+    {
+	fprintf(stderr, "pgm_build: %s does not have packed keys\n", tbl->mapped_file);
+	return 0;
+    }
+
+    struct pgm_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.count = tbl->len;
+    hdr.epsilon = PGM_EPSILON;
+    hdr.epsilon_rec = PGM_EPSILON_REC;
+
+    struct pgm_segment *levels[PGM_MAX_LEVELS];
+    struct fitter f;
+    memset(&f, 0, sizeof(f));
+    f.eps = PGM_EPSILON;
+    unsigned long n;
+    int ok = 1;
+    for (n = 0; ok && n < tbl->len; n++)
+	ok = fit_point(&f, get_key_at(tbl, n), n);
+    ok = ok && fit_close(&f);
+
+    int nlevels = 0;
+    for (;;)
+    {
+	if (!ok)
+	{
+	    fprintf(stderr, "pgm_build: cannot allocate segments\n");
+	    free(f.segs);
+	    while (nlevels > 0)
+		free(levels[--nlevels]);
+	    return 0;
+	}
+	levels[nlevels] = f.segs;
+	hdr.level_count[nlevels] = f.nsegs;
+	nlevels++;
+	if (f.nsegs <= 1 || nlevels == PGM_MAX_LEVELS)
+	    break;
+
+	/*
+	 * Fit the next level over the first keys of this one.
+	 */
+	const struct pgm_segment *below = f.segs;
+	uint64_t nbelow = f.nsegs;
+	memset(&f, 0, sizeof(f));
+	f.eps = PGM_EPSILON_REC;
+	uint64_t i;
+	for (i = 0; ok && i < nbelow; i++)
+	    ok = fit_point(&f, below[i].key, i);
+	ok = ok && fit_close(&f);
+    }
+    hdr.nlevels = nlevels;
+
+    size_t offsets[PGM_MAX_LEVELS];
+    size_t sz = ROUND64(sizeof(hdr));
+    int l;
+    for (l = 0; l < nlevels; l++)
+    {
+	offsets[l] = sz;
+	sz = ROUND64(sz + hdr.level_count[l] * sizeof(struct pgm_segment));
+    }
+
+    char *buf = (char *) calloc(sz, 1);
+    if (buf == 0)
+	fprintf(stderr, "pgm_build: cannot allocate %zu bytes\n", sz);
+    else
+    {
+	memcpy(buf, &hdr, sizeof(hdr));
+	for (l = 0; l < nlevels; l++)
+	    memcpy(buf + offsets[l], levels[l], hdr.level_count[l] * sizeof(struct pgm_segment));
+    }
+    for (l = 0; l < nlevels; l++)
+	free(levels[l]);
+    if (buf == 0)
+	return 0;
+
+    *data = buf;
+    *size = sz;
+    return 1;
+}
+
+int pgm_load(struct pgm_index *idx, const void *data, size_t size)
+{
+    const struct pgm_header *hdr = (const struct pgm_header *) data;
+    if (size < sizeof(*hdr) || hdr->nlevels < 1 || hdr->nlevels > PGM_MAX_LEVELS ||
+	hdr->level_count[hdr->nlevels - 1] > 1)
+    {
+	fprintf(stderr, "pgm_load: index has invalid header\n");
+	return 0;
+    }
+
+    memset(idx, 0, sizeof(*idx));
+    size_t off = ROUND64(sizeof(*hdr));
+    int l;
+    for (l = 0; l < (int) hdr->nlevels; l++)
+    {
+	idx->levels[l] = (const struct pgm_segment *) ((const char *) data + off);
+	idx->level_count[l] = hdr->level_count[l];
+	off = ROUND64(off + hdr->level_count[l] * sizeof(struct pgm_segment));
+    }
+    if (off != size)
+    {
+	fprintf(stderr, "pgm_load: index has invalid size %zu\n", size);
+	return 0;
+    }
+
+    idx->count = hdr->count;
+    idx->epsilon = hdr->epsilon;
+    idx->epsilon_rec = hdr->epsilon_rec;
+    idx->nlevels = hdr->nlevels;
+    return 1;
+}
+
+void pgm_window(const struct pgm_index *idx, int l, uint64_t s, uint64_t key,
+		uint64_t *lo, uint64_t *hi)
+{
+    uint64_t count = l ? idx->level_count[l - 1] : idx->count;
+    int eps = l ? idx->epsilon_rec : idx->epsilon;
+    window(predict(idx->levels[l], idx->level_count[l], s, count, key), eps, count, lo, hi);
+}
+
+uint64_t pgm_segment(const struct pgm_index *idx, int l, uint64_t lo, uint64_t hi, uint64_t key)
+{
+    /*
+     * Branch-free: the windows are small and their cache lines are
+     * usually at hand, so mispredicted branches would dominate.
+     */
+    const struct pgm_segment *segs = idx->levels[l];
+    uint64_t n = hi - lo;
+    if (n == 0)
+	return lo ? lo - 1 : 0;
+    while (n > 1)
+    {
+	uint64_t half = n / 2;
+	lo = segs[lo + half].key <= key ? lo + half : lo;
+	n -= half;
+    }
+    if (segs[lo].key <= key)
+	return lo;
+    return lo ? lo - 1 : 0;
+}
+
+void pgm_range(const struct pgm_index *idx, uint64_t key, unsigned long *start, unsigned long *len)
+{
+    if (idx->count == 0)
+    {
+	*start = *len = 0;
+	return;
+    }
+
+    uint64_t s = 0;
+    uint64_t lo, hi;
+    int l;
+    for (l = idx->nlevels - 1; l > 0; l--)
+    {
+	pgm_window(idx, l, s, key, &lo, &hi);
+	s = pgm_segment(idx, l - 1, lo, hi, key);
+    }
+    pgm_window(idx, 0, s, key, &lo, &hi);
+    *start = lo;
+    *len = hi - lo;
+}
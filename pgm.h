@@ -0,0 +1,94 @@
+#ifndef _pgm_h
+#define _pgm_h
+
+/*
+ * Learned index (PGM style) over the packed keys of a sorted table.
+ *
+ * The table's keys are covered by linear segments, each predicting the
+ * position of any of its keys to within epsilon entries. A lookup finds
+ * the key's segment, predicts its position, and binary searches only the
+ * 2 * epsilon entries around the prediction. The segments are found the
+ * same way from a smaller set of segments over their first keys, and so
+ * on up to a single segment, so a lookup touches a few cache lines per
+ * level instead of one per halving of the table.
+ *
+ * Keys that are dense in the key space need few segments: the index is
+ * usually a few MB even for billions of keys.
+ *
+ * The serialized index is a pgm_header followed by the segments of each
+ * level, bottom level first, each level starting on a 64-byte boundary.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PGM_MAGIC 0x50474d49	/* "PGMI" */
+#define PGM_SUFFIX ".pgm"
+
+/*
+ * Prediction error bound for the table, and for the upper levels.
+ */
+#define PGM_EPSILON 32
+#define PGM_EPSILON_REC 8
+
+#define PGM_MAX_LEVELS 16
+
+struct motif_table;
+
+struct pgm_segment
+{
+    uint64_t key;		/* first key covered */
+    double slope;
+    int64_t intercept;		/* position of key */
+};
+
+struct pgm_header
+{
+    uint64_t count;
+    uint32_t epsilon;
+    uint32_t epsilon_rec;
+    uint32_t nlevels;
+    uint32_t reserved0;
+    uint64_t level_count[PGM_MAX_LEVELS];
+    uint64_t reserved[2];
+};
+
+struct pgm_index
+{
+    uint64_t count;
+    int epsilon;
+    int epsilon_rec;
+    int nlevels;
+    uint64_t level_count[PGM_MAX_LEVELS];
+    const struct pgm_segment *levels[PGM_MAX_LEVELS];
+};
+
+int pgm_build(struct motif_table *tbl, void **data, size_t *size);
+int pgm_load(struct pgm_index *idx, const void *data, size_t size);
+
+/*
+ * Set [*start, *start + *len) to the entries that key must be among if
+ * it is in the table.
+ */
+void pgm_range(const struct pgm_index *idx, uint64_t key, unsigned long *start, unsigned long *len);
+
+/*
+ * The steps of pgm_range, for callers interleaving several lookups.
+ * pgm_window sets [*lo, *hi) to the positions on level l - 1 (or in the
+ * table, for l = 0) that segment s of level l predicts for key;
+ * pgm_segment finds key's segment on level l among [lo, hi).
+ */
+void pgm_window(const struct pgm_index *idx, int l, uint64_t s, uint64_t key,
+		uint64_t *lo, uint64_t *hi);
+uint64_t pgm_segment(const struct pgm_index *idx, int l, uint64_t lo, uint64_t hi, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _pgm_h */
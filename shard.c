@@ -0,0 +1,255 @@
+
+#include "shard.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+static int compare_prefix(const char *motif, const char *bound, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+    {
+	int c = toupper((unsigned char) motif[i]);
+	if (c != bound[i])
+	    return c < bound[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+int is_shard_manifest(const char *file)
+{
+    char sig[sizeof(MOTIF_SHARD_SIGNATURE) - 1];
+    FILE *fp = fopen(file, "r");
+    if (fp == 0)
+	return 0;
+    int ok = fread(sig, sizeof(sig), 1, fp) == 1 && memcmp(sig, MOTIF_SHARD_SIGNATURE, sizeof(sig)) == 0;
+    fclose(fp);
+    return ok;
+}
+
+int read_shard_manifest(const char *file, struct motif_shard_set *set)
+{
+    memset(set, 0, sizeof(*set));
+    strncpy(set->manifest, file, sizeof(set->manifest) - 1);
+
+    FILE *fp = fopen(file, "r");
+    if (fp == 0)
+    {
+	fprintf(stderr, "Error opening %s: %s\n", file, strerror(errno));
+	return 0;
+    }
+
+    int version;
+    if (fscanf(fp, MOTIF_SHARD_SIGNATURE " %d %d", &version, &set->motif_len) != 2 ||
+	version != 1 || set->motif_len < 1)
+    {
+	fprintf(stderr, "%s: not a shard manifest\n", file);
+	fclose(fp);
+	return 0;
+    }
+
+    const char *slash = strrchr(file, '/');
+    int dirlen = slash ? slash - file + 1 : 0;
+
+    int cap = 0;
+    int ok = 1;
+    int lineno = 1;
+    char line[2048];
+    while (ok && fgets(line, sizeof(line), fp))
+    {
+	char first[64], last[64], name[1024];
+	char *p = line + strspn(line, " \t\r\n");
+	if (lineno++ == 1 || *p == 0 || *p == '#')
+	    continue;
+	if (sscanf(p, "%63s %63s %1023s", first, last, name) != 3)
+	{
+	    fprintf(stderr, "%s:%d: expected <first> <last> <file>\n", file, lineno - 1);
+	    ok = 0;
+	    break;
+	}
+	int plen = strlen(first);
+	if (set->nshards == 0)
+	    set->prefix_len = plen;
+	if (plen != set->prefix_len || (int) strlen(last) != plen ||
+	    plen > MOTIF_MAX_SHARD_PREFIX || plen > set->motif_len)
+	{
+	    fprintf(stderr, "%s:%d: shard prefixes must all have the same length, at most %d\n",
+		    file, lineno - 1, MOTIF_MAX_SHARD_PREFIX);
+	    ok = 0;
+	    break;
+	}
+
+	if (set->nshards == cap)
+	{
+	    cap = cap ? 2 * cap : 16;
+	    struct motif_shard *s = (struct motif_shard *) realloc(set->shards, cap * sizeof(*s));
+	    if (s == 0)
+	    {
+		fprintf(stderr, "%s: cannot allocate shards\n", file);
+		ok = 0;
+		break;
+	    }
+	    set->shards = s;
+	}
+	struct motif_shard *sh = &set->shards[set->nshards];
+	memset(sh, 0, sizeof(*sh));
+	int i;
+	for (i = 0; i < plen; i++)
+	{
+	    sh->first[i] = toupper((unsigned char) first[i]);
+	    sh->last[i] = toupper((unsigned char) last[i]);
+	}
+	if (name[0] == '/' || dirlen == 0)
+	    sh->file = strdup(name);
+	else
+	{
+	    sh->file = (char *) malloc(dirlen + strlen(name) + 1);
+	    if (sh->file)
+		sprintf(sh->file, "%.*s%s", dirlen, file, name);
+	}
+	set->nshards++;
+	if (sh->file == 0)
+	{
+	    fprintf(stderr, "%s: cannot allocate shards\n", file);
+	    ok = 0;
+	}
+	else if (strcmp(sh->first, sh->last) > 0 ||
+		 (set->nshards > 1 && strcmp(sh[-1].last, sh->first) >= 0))
+	{
+	    fprintf(stderr, "%s:%d: shards out of order or overlapping\n", file, lineno - 1);
+	    ok = 0;
+	}
+    }
+    fclose(fp);
+
+    if (ok && set->nshards == 0)
+    {
+	fprintf(stderr, "%s: no shards\n", file);
+	ok = 0;
+    }
+    if (!ok)
+	free_shard_set(set);
+    return ok;
+}
+
+void free_shard_set(struct motif_shard_set *set)
+{
+    int i;
+    for (i = 0; i < set->nshards; i++)
+    {
+	if (set->shards[i].mapped)
+	    unmap_table(&set->shards[i].table);
+	free(set->shards[i].file);
+    }
+    free(set->shards);
+    set->shards = 0;
+    set->nshards = 0;
+    set->nmapped = 0;
+}
+
+int find_shard(const struct motif_shard_set *set, const char *motif)
+{
+    int lo = 0;
+    int hi = set->nshards;
+    while (lo < hi)
+    {
+	int mid = (lo + hi) / 2;
+	if (compare_prefix(motif, set->shards[mid].last, set->prefix_len) > 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if (lo < set->nshards && compare_prefix(motif, set->shards[lo].first, set->prefix_len) >= 0)
+	return lo;
+    return -1;
+}
+
+struct motif_table *get_shard_table(struct motif_shard_set *set, int i)
+{
+    struct motif_shard *sh = &set->shards[i];
+    sh->last_used = ++set->clock;
+    sh->batch = set->batch;
+    if (sh->mapped)
+	return &sh->table;
+    if (sh->failed)
+	return 0;
+
+    while (set->max_mapped > 0 && set->nmapped >= set->max_mapped)
+    {
+	int lru = -1;
+	int j;
+	for (j = 0; j < set->nshards; j++)
+	{
+	    struct motif_shard *s = &set->shards[j];
+	    if (s->mapped && s->batch != set->batch && (lru < 0 || s->last_used < set->shards[lru].last_used))
+		lru = j;
+	}
+	if (lru < 0)
+	    break;
+	unmap_table(&set->shards[lru].table);
+	set->shards[lru].mapped = 0;
+	set->nmapped--;
+    }
+
+    if (!acquire_table(sh->file, &sh->table, set->map_opts))
+    {
+	sh->failed = 1;
+	return 0;
+    }
+    if (sh->table.header.motif_len != set->motif_len)
+    {
+	fprintf(stderr, "%s: shard %s has motif length %d, not %d\n", set->manifest,
+		sh->file, (int) sh->table.header.motif_len, set->motif_len);
+	unmap_table(&sh->table);
+	sh->failed = 1;
+	return 0;
+    }
+    if (set->search != SEARCH_AUTO && !set_search_method(&sh->table, set->search))
+	fprintf(stderr, "%s: shard %s does not have an index for search method %s\n",
+		set->manifest, sh->file, search_method_name(set->search));
+    sh->mapped = 1;
+    set->nmapped++;
+    return &sh->table;
+}
+
+void begin_shard_batch(struct motif_shard_set *set)
+{
+    set->batch++;
+}
+
+struct motif_table *first_shard_table(struct motif_shard_set *set)
+{
+    int i;
+    for (i = 0; i < set->nshards; i++)
+    {
+	if (set->shards[i].mapped)
+	    return &set->shards[i].table;
+    }
+    for (i = 0; i < set->nshards; i++)
+    {
+	struct motif_table *tbl = get_shard_table(set, i);
+	if (tbl)
+	    return tbl;
+    }
+    return 0;
+}
+
+int get_shard_search_method(struct motif_shard_set *set)
+{
+    struct motif_table *tbl = first_shard_table(set);
+    return tbl ? tbl->search : set->search;
+}
+
+int set_shard_search_method(struct motif_shard_set *set, int method)
+{
+    int ok = 1;
+    int i;
+    set->search = method;
+    for (i = 0; i < set->nshards; i++)
+    {
+	if (set->shards[i].mapped && !set_search_method(&set->shards[i].table, method))
+	    ok = 0;
+    }
+    return ok;
+}
@@ -0,0 +1,124 @@
+#ifndef _shard_h
+#define _shard_h
+
+/*
+ * Tables split into shards by motif prefix.
+ *
+ * A shard manifest is a text file listing the shards of a table, each
+ * an ordinary table file holding the motifs whose prefix lies in a
+ * range:
+ *
+ *    MOTIFSHARDS 1 <motif_len>
+ *    <first> <last> <file>
+ *    ...
+ *
+ * first and last are the inclusive bounds of the shard's prefixes,
+ * compared as uppercase strings; every bound in a manifest has the
+ * same length (at most MOTIF_MAX_SHARD_PREFIX). Shards are listed in
+ * increasing order and may not overlap; motifs outside every range
+ * are not in the table. Relative file names are taken relative to the
+ * manifest's directory. Blank lines and lines starting with # are
+ * ignored.
+ *
+ * A shard is only mapped when a lookup is first routed to it, and at
+ * most max_mapped shards (if nonzero) are kept mapped, the least
+ * recently used being unmapped to make room. Shards used since the
+ * last begin_shard_batch are never unmapped, so entry numbers found in
+ * a batch stay valid until the next one starts; a batch touching more
+ * than max_mapped shards maps them all. Each shard is mapped with the
+ * residency options map_opts. A shard that fails to map is not tried
+ * again.
+ */
+
+#include "table.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOTIF_SHARD_SIGNATURE "MOTIFSHARDS"
+#define MOTIF_MAX_SHARD_PREFIX 8
+
+struct motif_shard
+{
+    char first[MOTIF_MAX_SHARD_PREFIX + 1];
+    char last[MOTIF_MAX_SHARD_PREFIX + 1];
+    char *file;
+    int mapped;
+    int failed;			/* could not be mapped */
+    uint64_t last_used;
+    uint64_t batch;		/* last batch that used the shard */
+    struct motif_table table;
+};
+
+struct motif_shard_set
+{
+    char manifest[1024];
+    int motif_len;
+    int prefix_len;
+    int nshards;
+    struct motif_shard *shards;
+    int nmapped;
+    int max_mapped;
+    uint64_t clock;
+    uint64_t batch;		/* current batch */
+    int search;			/* applied to each shard as it is mapped */
+    int map_opts;		/* MOTIF_MAP_* residency of each shard */
+};
+
+/*
+ * Return 1 if file is a shard manifest.
+ */
+int is_shard_manifest(const char *file);
+
+/*
+ * Read a manifest into set, without mapping any shard. Returns 0 on
+ * error.
+ */
+int read_shard_manifest(const char *file, struct motif_shard_set *set);
+
+/*
+ * Unmap every shard and free the set.
+ */
+void free_shard_set(struct motif_shard_set *set);
+
+/*
+ * The shard that motif belongs in, or -1 if none.
+ */
+int find_shard(const struct motif_shard_set *set, const char *motif);
+
+/*
+ * The table of shard i, mapping it if need be. Returns 0 if it cannot
+ * be mapped or does not match the manifest.
+ */
+struct motif_table *get_shard_table(struct motif_shard_set *set, int i);
+
+/*
+ * Start a batch of lookups, releasing the shards the previous batch
+ * kept mapped.
+ */
+void begin_shard_batch(struct motif_shard_set *set);
+
+/*
+ * The first mapped shard's table, or if none is mapped the first
+ * shard that can be. Returns 0 if no shard can be mapped.
+ */
+struct motif_table *first_shard_table(struct motif_shard_set *set);
+
+/*
+ * The search method the shards use, as resolved against the indexes
+ * of first_shard_table.
+ */
+int get_shard_search_method(struct motif_shard_set *set);
+
+/*
+ * Set the search method of the mapped shards, and of those mapped
+ * later. Returns 0 if a mapped shard lacks the method's index.
+ */
+int set_shard_search_method(struct motif_shard_set *set, int method);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _shard_h */
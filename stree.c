@@ -0,0 +1,150 @@
+
+#include "stree.h"
+#include "table.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+/*
+ * Fill the tree in order from the sorted table.
+ */
+static void fill(struct motif_table *tbl, uint64_t *keys, uint32_t *entries,
+		 uint64_t nblocks, uint64_t *next, uint64_t k)
+{
+    if (k >= nblocks)
+	return;
+    int i;
+    for (i = 0; i < STREE_B; i++)
+    {
+	fill(tbl, keys, entries, nblocks, next, stree_child(k, i));
+	if (*next < tbl->len)
+	{
+	    keys[k * STREE_B + i] = get_key_at(tbl, *next);
+	    entries[k * STREE_B + i] = (uint32_t) *next;
+	    (*next)++;
+	}
+	else
+	{
+	    keys[k * STREE_B + i] = STREE_PAD;
+	    entries[k * STREE_B + i] = UINT32_MAX;
+	}
+    }
+    fill(tbl, keys, entries, nblocks, next, stree_child(k, STREE_B));
+}
+
+int stree_build(struct motif_table *tbl, void **data, size_t *size)
+{
+    if (!(tbl->header.flags & MOTIF_TABLE_PACKED_KEYS))
+    {
+	fprintf(stderr, "stree_build: %s does not have packed keys\n", tbl->mapped_file);
+	return 0;
+    }
+    if (is_large_table(tbl))
+    {
+	fprintf(stderr, "stree_build: %s has too many entries\n", tbl->mapped_file);
+	return 0;
+    }
+
+    uint64_t count = tbl->len;
+    uint64_t nblocks = (count + STREE_B - 1) / STREE_B;
+    size_t sz = sizeof(struct stree_header) +
+	nblocks * STREE_B * (sizeof(uint64_t) + sizeof(uint32_t));
+    char *buf = (char *) calloc(sz, 1);
+    if (buf == 0)
+    {
+	fprintf(stderr, "stree_build: cannot allocate %zu bytes\n", sz);
+	return 0;
+    }
+
+    struct stree_header *hdr = (struct stree_header *) buf;
+    hdr->count = count;
+    hdr->nblocks = nblocks;
+    uint64_t *keys = (uint64_t *) (buf + sizeof(*hdr));
+    uint32_t *entries = (uint32_t *) (keys + nblocks * STREE_B);
+
+    uint64_t next = 0;
+    fill(tbl, keys, entries, nblocks, &next, 0);
+
+    *data = buf;
+    *size = sz;
+    return 1;
+}
+
+int stree_load(struct stree_index *idx, const void *data, size_t size)
+{
+    const struct stree_header *hdr = (const struct stree_header *) data;
+    if (size < sizeof(*hdr) ||
+	size != sizeof(*hdr) + hdr->nblocks * STREE_B * (sizeof(uint64_t) + sizeof(uint32_t)))
+    {
+	fprintf(stderr, "stree_load: index has invalid size %zu\n", size);
+	return 0;
+    }
+
+    idx->count = hdr->count;
+    idx->nblocks = hdr->nblocks;
+    idx->keys = (const uint64_t *) ((const char *) data + sizeof(*hdr));
+    idx->entries = (const uint32_t *) (idx->keys + idx->nblocks * STREE_B);
+#ifdef HAVE_AVX2_KERNEL
+    idx->use_avx2 = __builtin_cpu_supports("avx2");
+#else
+    idx->use_avx2 = 0;
+#endif
+    return 1;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+/*
+ * Packed keys and STREE_PAD are below 2^63, so the signed 64-bit
+ * compare orders them correctly.
+ */
+__attribute__((target("avx2")))
+static int rank_avx2(const uint64_t *node, uint64_t key)
+{
+    __m256i x = _mm256_set1_epi64x((long long) key);
+    int mask = 0;
+    int i;
+    for (i = 0; i < STREE_B; i += 4)
+    {
+	__m256i y = _mm256_load_si256((const __m256i *) (node + i));
+	__m256i lt = _mm256_cmpgt_epi64(x, y);
+	mask |= _mm256_movemask_pd(_mm256_castsi256_pd(lt)) << i;
+    }
+    return __builtin_popcount(mask);
+}
+#endif
+
+int stree_rank(const struct stree_index *idx, uint64_t k, uint64_t key)
+{
+    const uint64_t *node = idx->keys + k * STREE_B;
+#ifdef HAVE_AVX2_KERNEL
+    if (idx->use_avx2)
+	return rank_avx2(node, key);
+#endif
+    int r = 0;
+    int i;
+    for (i = 0; i < STREE_B; i++)
+	r += node[i] < key;
+    return r;
+}
+
+long stree_find(const struct stree_index *idx, uint64_t key)
+{
+    uint64_t k = 0;
+    uint64_t found = UINT64_MAX;
+
+    while (k < idx->nblocks)
+    {
+	int i = stree_rank(idx, k, key);
+	if (i < STREE_B)
+	    found = k * STREE_B + i;
+	k = stree_child(k, i);
+    }
+
+    if (found == UINT64_MAX || idx->keys[found] != key)
+	return -1;
+    return idx->entries[found];
+}
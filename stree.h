@@ -0,0 +1,73 @@
+#ifndef _stree_h
+#define _stree_h
+
+/*
+ * Static B-tree ("S-tree") search index over the packed keys of a table.
+ *
+ * Each node holds STREE_B sorted keys in two cache lines and has
+ * STREE_B + 1 children; the children of node k are k * (STREE_B + 1) + i + 1.
+ * A node is searched by comparing the query against all of its keys at
+ * once (AVX2 where the CPU has it) and counting the keys that are less,
+ * which is also the child to descend to. A lookup touches one node per
+ * level, about log17(N) of them. Unused slots in the last nodes hold
+ * STREE_PAD, which is larger than any packed key.
+ *
+ * The serialized index is an stree_header followed by the node keys
+ * and a parallel array of entry numbers.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREE_MAGIC 0x53545245	/* "STRE" */
+#define STREE_SUFFIX ".stree"
+
+#define STREE_B 16
+#define STREE_PAD INT64_MAX
+
+struct motif_table;
+
+struct stree_header
+{
+    uint64_t count;
+    uint64_t nblocks;
+    uint64_t reserved[6];
+};
+
+struct stree_index
+{
+    uint64_t count;
+    uint64_t nblocks;
+    const uint64_t *keys;	/* nblocks * STREE_B */
+    const uint32_t *entries;
+    int use_avx2;
+};
+
+int stree_build(struct motif_table *tbl, void **data, size_t *size);
+int stree_load(struct stree_index *idx, const void *data, size_t size);
+
+/*
+ * Return the number of keys in node k that are less than key.
+ */
+int stree_rank(const struct stree_index *idx, uint64_t k, uint64_t key);
+
+inline uint64_t stree_child(uint64_t k, int i)
+{
+    return k * (STREE_B + 1) + i + 1;
+}
+
+/*
+ * Return the entry number holding key, or -1.
+ */
+long stree_find(const struct stree_index *idx, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _stree_h */
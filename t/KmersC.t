@@ -5,7 +5,7 @@
 
 # change 'tests => 1' to 'tests => last_test_to_print';
 
-use Test::More tests => 1;
+use Test::More tests => 58;
 BEGIN { use_ok('KmersC') };
 
 #########################
@@ -13,3 +13,558 @@ BEGIN { use_ok('KmersC') };
 # Insert your test code below, the Test::More module is use()ed here so read
 # its man page ( perldoc Test::More ) for help writing this test script.
 
+
+# Run code with stderr, including the library's, sent to a file, and
+# return what it printed.
+sub stderr_of
+{
+    my ($code) = @_;
+    my $errfile = "/tmp/test2.$$.err";
+    open(my $saved, ">&", \*STDERR);
+    open(STDERR, ">", $errfile);
+    $code->();
+    open(STDERR, ">&", $saved);
+    open(my $ef, "<", $errfile);
+    local $/;
+    my $text = <$ef>;
+    close($ef);
+    unlink $errfile;
+    return $text;
+}
+
+# Set and clear bits of the flags in a version 2 table's header.
+sub patch_flags
+{
+    my ($file, $set, $clear) = @_;
+    open(my $fh, "+<", $file);
+    binmode($fh);
+    seek($fh, 32, 0);
+    read($fh, my $flags, 4);
+    seek($fh, 32, 0);
+    print $fh pack("l<", (unpack("l<", $flags) | $set) & ~$clear);
+    close($fh);
+}
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4,1]);
+ok($cr->set_packed_keys(1), "packed keys");
+$file = "/tmp/test2.$$.dat";
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry("ABCDEFGH",[1,2]);
+$cr->write_entry("ABCDFFHI",[3,4]);
+$cr->write_entry("WXYZWXYZ",[5,6]);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_all_hits("xyzabcdefghijxafdABCDFFHIjjasd*wxyzwxyz", $l);
+is_deeply($l, [[3, "abcdefgh", 1, 2], [17, "ABCDFFHI", 3, 4], [31, "wxyzwxyz", 5, 6]], "packed key hits");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4,1]);
+$cr->set_packed_keys(1);
+$cr->set_eytzinger_index(1);
+$cr->set_stree_index(1);
+$cr->set_pgm_index(1);
+$cr->set_bloom_filter(0.01);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["ABCDEFGH",[1,2]], ["ABCDFFHI",[3,4]], ["WXYZWXYZ",[5,6]]);
+$cr->close_file();
+ok(-e "$file.eytz", "eytzinger index written");
+ok(-e "$file.bloom", "bloom filter written");
+
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_all_hits("xyzabcdefghijxafdABCDFFHIjjasd*wxyzwxyz", $l);
+is($k->get_search_method(), "stree", "s-tree preferred");
+is_deeply($l, [[3, "abcdefgh", 1, 2], [17, "ABCDFFHI", 3, 4], [31, "wxyzwxyz", 5, 6]], "s-tree index hits");
+$k->set_search_method("eytzinger");
+$l = [];
+$k->find_all_hits("xyzabcdefghijxafdABCDFFHIjjasd*wxyzwxyz", $l);
+is_deeply($l, [[3, "abcdefgh", 1, 2], [17, "ABCDFFHI", 3, 4], [31, "wxyzwxyz", 5, 6]], "eytzinger index hits");
+ok($k->set_search_method("pgm"), "learned index loaded");
+$l = [];
+$k->find_all_hits("xyzabcdefghijxafdABCDFFHIjjasd*wxyzwxyz", $l);
+is_deeply($l, [[3, "abcdefgh", 1, 2], [17, "ABCDFFHI", 3, 4], [31, "wxyzwxyz", 5, 6]], "learned index hits");
+$l = [];
+$k->find_motif_hits(["WXYZWXYZ", "ABCDEFGG", "ABCDEFGH"], $l);
+is_deeply($l, [[0, "WXYZWXYZ", 5, 6], [2, "ABCDEFGH", 1, 2]], "batched motif hits");
+unlink $file, "$file.eytz", "$file.stree", "$file.pgm", "$file.bloom";
+
+# Enough keys for a three-level S-tree, so that lookups rank internal
+# nodes as well as leaves.
+my @aa = split //, "ACDEFGHIKLMNPQRSTVWY";
+my @big;
+for my $i (0..4999)
+{
+    my $x = $i * 104729 + 17;
+    push @big, join "", map { my $c = $aa[$x % 20]; $x = int($x / 20); $c } 1..8;
+}
+@big = sort @big;
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_packed_keys(1);
+$cr->set_stree_index(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($big[$_], [$_]) for 0..$#big;
+$cr->close_file();
+$k = new KmersC();
+$k->open_data($file);
+my @probes = (@big, map { substr($_, 0, 7) . "A" } @big[0..99]);
+my ($ls, $lb) = ([], []);
+$k->find_motif_hits(\@probes, $ls);
+is($k->get_search_method() . " " . scalar(grep { $_->[0] < @big && $_->[2] == $_->[0] } @$ls), "stree 5000", "deep s-tree finds every key");
+$k->set_search_method("binary");
+$k->find_motif_hits(\@probes, $lb);
+is_deeply($ls, $lb, "deep s-tree agrees with binary search");
+unlink $file, "$file.stree";
+
+# The same keys give the perfect hash several levels and fingerprint
+# rejections of absent keys.
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_packed_keys(1);
+$cr->set_mphf_index(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($big[$_], [$_]) for 0..$#big;
+$cr->close_file();
+$k = new KmersC();
+$k->open_data($file);
+my $lm = [];
+$k->set_search_method("mphf");
+$k->find_motif_hits(\@probes, $lm);
+is_deeply([$k->get_search_method(), $lm], ["mphf", $lb], "perfect hash agrees with binary search");
+unlink $file, "$file.mphf";
+
+# Enough keys for several PGM segments and levels.
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_packed_keys(1);
+$cr->set_pgm_index(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($big[$_], [$_]) for 0..$#big;
+$cr->close_file();
+$k = new KmersC();
+$k->open_data($file);
+my $lp = [];
+$k->set_search_method("pgm");
+$k->find_motif_hits(\@probes, $lp);
+is_deeply([$k->get_search_method(), $lp], ["pgm", $lb], "learned index agrees with binary search");
+unlink $file, "$file.pgm";
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4,1]);
+$cr->set_mphf_index(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["ABCDEFGH",[1,2]], ["ABCDFFHI",[3,4]], ["WXYZWXYZ",[5,6]]);
+$cr->close_file();
+ok(-e "$file.mphf", "mphf index written");
+
+$k = new KmersC();
+$k->open_data($file);
+is($k->get_search_method(), "mphf", "mphf preferred");
+$l = [];
+$k->find_all_hits("xyzABCDEFGHijxafdABCDFFHIjjasd*WXYZWXYZ", $l);
+is_deeply($l, [[3, "ABCDEFGH", 1, 2], [17, "ABCDFFHI", 3, 4], [31, "WXYZWXYZ", 5, 6]], "mphf index hits");
+unlink $file, "$file.mphf";
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4,1]);
+$cr->set_packed_keys(1);
+$cr->set_cuckoo_table(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["WXYZWXYZ",[5,6]], ["ABCDEFGH",[1,2]], ["ABCDFFHI",[3,4]]);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+is($k->get_search_method(), "cuckoo", "cuckoo table detected");
+$l = [];
+$k->find_all_hits("xyzabcdefghijxafdABCDFFHIjjasd*wxyzwxyz", $l);
+is_deeply($l, [[3, "abcdefgh", 1, 2], [17, "ABCDFFHI", 3, 4], [31, "wxyzwxyz", 5, 6]], "packed cuckoo hits");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4,1]);
+$cr->set_cuckoo_table(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["WXYZWXYZ",[5,6]], ["ABCDFFHI",[3,4]], ["ABCDEFGH",[1,2]]);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_motif_hits(["WXYZWXYZ", "ABCDEFGG", "ABCDEFGH", "ABCDFFHI"], $l);
+is_deeply($l, [[0, "WXYZWXYZ", 5, 6], [2, "ABCDEFGH", 1, 2], [3, "ABCDFFHI", 3, 4]], "unpacked cuckoo hits");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_packed_keys(1);
+$cr->set_cuckoo_table(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry("ABCDEFGH", [$_]) for 1..10;
+ok(!$cr->close_file(), "cuckoo table rejects duplicate motifs");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [2,4]);
+$cr->set_format_version(2);
+$cr->set_packed_keys(1);
+$cr->set_stree_index(1);
+$cr->set_bloom_filter(0.01);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["ABCDEFGH",[1,-2]], ["ABCDFFHI",[60000,70000]], ["WXYZWXYZ",[5,6]]);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+ok(!-e "$file.stree" && $k->get_search_method() eq "stree", "version 2 index section");
+$l = [];
+$k->find_all_hits("xyzabcdefghijxafdABCDFFHIjjasd*wxyzwxyz", $l);
+is_deeply($l, [[3, "abcdefgh", 1, -2], [17, "ABCDFFHI", 60000, 70000], [31, "wxyzwxyz", 5, 6]], "version 2 hits");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 3, [4,1]);
+$cr->set_format_version(2);
+$cr->set_columnar_attrs(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["ABCDEFGH",[1,2]], ["ABCDFFHI",[-3,4]], ["WXYZWXYZ",[70000,6]]);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_motif_hits(["WXYZWXYZ", "ABCDEFGG", "ABCDEFGH", "ABCDFFHI"], $l);
+is_deeply($l, [[0, "WXYZWXYZ", 70000, 6], [2, "ABCDEFGH", 1, 2], [3, "ABCDFFHI", -3, 4]], "columnar attribute hits");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4,2,1]);
+$cr->set_format_version(2);
+$cr->set_packed_keys(1);
+$cr->set_bitpacked_attrs(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["ABCDEFGH",[-70000,7,-5]], ["ABCDFFHI",[123456,65535,-5]], ["WXYZWXYZ",[0,-1,300]]);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_all_hits("xyzabcdefghijxafdABCDFFHIjjasd*wxyzwxyz", $l);
+is_deeply($l, [[3, "abcdefgh", -70000, 7, -5], [17, "ABCDFFHI", 123456, 65535, -5], [31, "wxyzwxyz", 0, 65535, 44]], "bit-packed attribute hits");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_format_version(2);
+$cr->set_bitpacked_attrs(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["ABCDEFGH",[-2000000000]], ["ABCDFFHI",[2147483647]], ["WXYZWXYZ",[5]]);
+$cr->close_file();
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_motif_hits(["ABCDEFGH", "ABCDFFHI", "WXYZWXYZ"], $l);
+is_deeply($l, [[0, "ABCDEFGH", -2000000000], [1, "ABCDFFHI", 2147483647], [2, "WXYZWXYZ", 5]], "bit-packed column spanning 2^32");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 3, [4,2]);
+$cr->set_format_version(2);
+$cr->set_dictionary_attrs(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], $_->[1]) for (["ABCDEFGH",[9,1]], ["ABCDFFHI",[-4,2]], ["MNMNMNMN",[9,1]], ["WXYZWXYZ",[-4,2]]);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_motif_hits(["WXYZWXYZ", "ABCDEFGG", "ABCDEFGH", "MNMNMNMN", "ABCDFFHI"], $l);
+is_deeply($l, [[0, "WXYZWXYZ", -4, 2], [2, "ABCDEFGH", 9, 1], [3, "MNMNMNMN", 9, 1], [4, "ABCDFFHI", -4, 2]], "dictionary attribute hits");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4,1]);
+$cr->set_format_version(2);
+$cr->set_front_coded_keys(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_, [ord(substr($_, 7)), 1]) for map { "ABCDEFG$_" } "A" .. "Z";
+$cr->write_entry("WXYZWXYZ", [5,6]);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+is($k->get_search_method(), "frontcoded", "front-coded table detected");
+$l = [];
+$k->find_motif_hits(["ABCDEFGA", "ABCDEFGR", "ABCDEFFZ", "ABCDEFGZ", "WXYZWXYZ", "AAAAAAAA", "ZZZZZZZZ"], $l);
+is_deeply($l, [[0, "ABCDEFGA", 65, 1], [1, "ABCDEFGR", 82, 1], [3, "ABCDEFGZ", 90, 1], [4, "WXYZWXYZ", 5, 6]], "front-coded hits");
+unlink $file;
+
+# Several 64-key blocks: probe the first and last key of each block,
+# and the absent keys on either side of them.
+my @all = map { "ABCD$_" } "AAAA" .. "AAZZ";
+my @fc = @all[grep { $_ % 2 == 0 } 0..$#all];
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_format_version(2);
+$cr->set_front_coded_keys(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($fc[$_], [$_]) for 0..$#fc;
+$cr->close_file();
+$k = new KmersC();
+$k->open_data($file);
+my @edges = ((grep { $_ < @fc } map { ($_ * 64, $_ * 64 + 63) } 0..int(@fc / 64)), $#fc);
+my @fprobes = map { ($all[2 * $_], $all[2 * $_ + 1]) } @edges;
+$l = [];
+$k->find_motif_hits(\@fprobes, $l);
+is_deeply($l, [map { [2 * $_, $fc[$edges[$_]], $edges[$_]] } 0..$#edges], "front-coded block boundaries");
+undef $k;
+patch_flags($file, 0, 0x4);
+$k = new KmersC();
+ok(!$k->open_data($file), "front-coded keys with row attributes rejected");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, []);
+$cr->set_format_version(2);
+$cr->set_packed_keys(1);
+$cr->set_elias_fano_keys(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_, []) for map { "ABCD$_" } "AAAA" .. "AACZ";
+$cr->write_entry("WXYZWXYZ", []);
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_all_hits("xABCDAAAAxABCDAAZZxABCDAACZxABCDAADAxwxyzwxyz", $l);
+is_deeply([$k->get_search_method(), @$l], ["eliasfano", [1, "ABCDAAAA"], [19, "ABCDAACZ"], [37, "wxyzwxyz"]], "Elias-Fano hits");
+unlink $file;
+
+# The 5000 keys of the S-tree test span many EF_SAMPLE blocks of the
+# upper bits; look up every one, and its reverse, which is mostly absent.
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_format_version(2);
+$cr->set_packed_keys(1);
+$cr->set_elias_fano_keys(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($big[$_], [$_]) for 0..$#big;
+$cr->close_file();
+$k = new KmersC();
+$k->open_data($file);
+my %bigindex = map { $big[$_] => $_ } 0..$#big;
+my @efprobes = map { ($_, join "", reverse split //, $_) } @big;
+$l = [];
+$k->find_motif_hits(\@efprobes, $l);
+my @efwant = map { [$_, $efprobes[$_], $bigindex{$efprobes[$_]}] } grep { exists $bigindex{$efprobes[$_]} } 0..$#efprobes;
+is_deeply($l, \@efwant, "Elias-Fano lookups across sample blocks");
+undef $k;
+patch_flags($file, 0, 0x4);
+$k = new KmersC();
+ok(!$k->open_data($file), "Elias-Fano keys with row attributes rejected");
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_format_version(2);
+$cr->set_packed_keys(1);
+$cr->set_elias_fano_keys(1);
+$cr->set_packed_keys(0);
+$cr->open_file($file);
+ok($cr->write_file_header() < 0, "Elias-Fano keys without packed keys rejected");
+$cr->close_file();
+unlink $file;
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [(1) x 32]);
+$cr->open_file($file);
+ok($cr->write_file_header() < 0, "more than 31 attributes rejected");
+$cr->close_file();
+unlink $file;
+
+my @kfiles;
+for my $len (6, 4)
+{
+    $cr = new KmersFileCreator(0xfeedface, $len, 0, [1]);
+    $cr->set_format_version(2);
+    $cr->set_packed_keys($len == 4);
+    $cr->open_file("$file.$len");
+    $cr->write_file_header();
+    $cr->write_entry(substr("ACDEFG", 0, $len), [$len]);
+    $cr->write_entry(substr("DEFGHI", 0, $len), [-$len]);
+    $cr->close_file();
+    push @kfiles, "$file.$len";
+}
+ok(KmersMulti::write_file($file, \@kfiles), "multi-k file written");
+my $m = new KmersMulti();
+$m->open_data($file);
+$l = [];
+$m->find_all_hits("xACDEFGHIx", $l);
+is_deeply($l, [[1, 4, "ACDE", 4], [1, 6, "ACDEFG", 6], [3, 4, "DEFG", -4], [3, 6, "DEFGHI", -6]], "multi-k hits");
+unlink $file, @kfiles;
+
+my @sfiles;
+for my $set (["AA", "DZ", "ABCDEFGH", "ACDEFGHI"], ["EA", "MZ", "KLMNKLMN", "MNMNMNMN"])
+{
+    my ($first, $last, @motifs) = @$set;
+    $cr = new KmersFileCreator(0xfeedface, 8, 0, [1]);
+    $cr->set_packed_keys(@sfiles == 1);
+    $cr->open_file("$file.$first");
+    $cr->write_file_header();
+    $cr->write_entry($_, [@sfiles + 1]) for @motifs;
+    $cr->close_file();
+    push @sfiles, "$file.$first";
+}
+open(my $mf, ">", $file);
+print $mf "MOTIFSHARDS 1 8\nAA DZ $sfiles[0]\nEA MZ $sfiles[1]\n";
+close($mf);
+$k = new KmersC();
+ok($k->open_data($file), "shard manifest opened");
+$k->set_max_mapped_shards(1);
+$l = [];
+my $maps = stderr_of(sub { $k->find_all_hits("ABCDEFGHxMNMNMNMNxACDEFGHIxQRSTVWYA", $l) });
+is_deeply($l, [[0, "ABCDEFGH", 1], [9, "MNMNMNMN", 2], [18, "ACDEFGHI", 1]], "sharded hits");
+is(scalar(() = $maps =~ /^mapped table/mg), 2, "each shard mapped once per lookup");
+unlink $file, @sfiles;
+
+my $delta = "$file.delta";
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [2]);
+$cr->set_format_version(2);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], [$_->[1]]) for ["ABCDEFGH", 1], ["CDEFGHIK", 2], ["KLMNPQRS", 3];
+$cr->close_file();
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [2]);
+$cr->set_format_version(2);
+$cr->set_packed_keys(1);
+$cr->set_delta_table(1);
+$cr->open_file($delta);
+$cr->write_file_header();
+$cr->write_entry("ABCDEFGH", [10]);
+$cr->write_entry("DEFGHIKL", [20]);
+$cr->write_tombstone("KLMNPQRS");
+$cr->close_file();
+
+$k = new KmersC();
+$k->open_data($file);
+ok($k->open_delta($delta), "delta table opened");
+$l = [];
+$k->find_all_hits("ABCDEFGHIKLMNPQRS", $l);
+is_deeply($l, [[0, "ABCDEFGH", 10], [2, "CDEFGHIK", 2], [3, "DEFGHIKL", 20]], "delta overrides base");
+my $compacted = "$file.compact";
+my $merged;
+stderr_of(sub { $merged = KmersFileCreator::compact_table($file, $delta, $compacted) });
+ok(!$merged && !-e $compacted, "packed delta not merged into raw motifs");
+unlink $file, $delta, $compacted;
+
+# Raw motifs keep their case, so the merge is in byte order; look up
+# every entry of the result.
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [2]);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], [$_->[1]]) for ["aaaaaaaa", 1], ["cccccccc", 3], ["eeeeeeee", 5];
+$cr->close_file();
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [2]);
+$cr->set_format_version(2);
+$cr->set_delta_table(1);
+$cr->open_file($delta);
+$cr->write_file_header();
+$cr->write_entry("DDDDDDDD", [4]);
+$cr->write_entry("bbbbbbbb", [2]);
+$cr->write_entry("cccccccc", [30]);
+$cr->write_tombstone("eeeeeeee");
+$cr->close_file();
+KmersFileCreator::compact_table($file, $delta, $compacted);
+$k = new KmersC();
+$k->open_data($compacted);
+$l = [];
+$k->find_motif_hits(["aaaaaaaa", "bbbbbbbb", "cccccccc", "DDDDDDDD", "eeeeeeee"], $l);
+is_deeply($l, [[0, "aaaaaaaa", 1], [1, "bbbbbbbb", 2], [2, "cccccccc", 30], [3, "DDDDDDDD", 4]], "compacted table finds every entry");
+unlink $file, $delta, $compacted;
+
+# A table marked large is searched without its 32-bit entry indexes.
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [2]);
+$cr->set_format_version(2);
+$cr->set_packed_keys(1);
+$cr->set_eytzinger_index(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($_->[0], [$_->[1]]) for ["ABCDEFGH", 1], ["CDEFGHIK", 2];
+$cr->close_file();
+patch_flags($file, 0x100, 0);
+$k = new KmersC();
+$k->open_data($file);
+$l = [];
+$k->find_motif_hits(["CDEFGHIK", "ABCDEFGH"], $l);
+is_deeply([$k->get_search_method(), $l], ["binary", [[0, "CDEFGHIK", 2], [1, "ABCDEFGH", 1]]], "large table ignores 32-bit indexes");
+unlink $file;
+
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [2]);
+$cr->set_format_version(2);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry("ABCDEFGH", [7]);
+$cr->close_file();
+$k = new KmersC();
+my $err = stderr_of(sub { ok(!$k->open_data($file, "populate,bogus"), "unknown residency option rejected") });
+like($err, qr/unknown residency option bogus/, "unknown residency option reported");
+$k->open_data($file, "populate,willneed,random");
+$l = [];
+$k->find_all_hits("xABCDEFGH", $l);
+is_deeply($l, [[1, "ABCDEFGH", 7]], "populated table hits");
+$k = new KmersC();
+$k->open_data($file, "hugepages");
+$l = [];
+$k->find_all_hits("xABCDEFGH", $l);
+ok(@$l == 1 && $k->get_page_size() > 0, "table copied to huge pages");
+my $k1 = new KmersC();
+$k1->open_data($file);
+my $k2 = new KmersC();
+$k2->open_data($file);
+is($k2->get_share_count(), 2, "open table shared");
+undef $k1;
+$l = [];
+$k2->find_all_hits("xABCDEFGH", $l);
+is_deeply([$k2->get_share_count(), @$l], [1, [1, "ABCDEFGH", 7]], "shared table outlives its first user");
+my $file2 = "$file.new";
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [2]);
+$cr->set_format_version(2);
+$cr->open_file($file2);
+$cr->write_file_header();
+$cr->write_entry("ABCDEFGH", [8]);
+$cr->write_entry("BCDEFGHI", [9]);
+$cr->close_file();
+ok($k2->reload($file2), "reload started");
+$k2->wait_reload();
+$l = [];
+$k2->find_all_hits("xABCDEFGHI", $l);
+is_deeply($l, [[1, "ABCDEFGH", 8], [2, "BCDEFGHI", 9]], "reloaded table in use");
+unlink $file2;
+$k = new KmersC();
+$k->open_data($file, "numa");
+$l = [];
+$k->find_all_hits("xABCDEFGH", $l);
+is_deeply($l, [[1, "ABCDEFGH", 7]], "NUMA replica hits");
+my $nodes = () = glob("/sys/devices/system/node/node[0-9]*");
+is($k->get_replica_count(), $nodes || 1, "a replica on each node");
+unlink $file;
+
+# Each entry's attribute is its entry number, so equal hits through a
+# replica and through the base mean equal entry numbers too.
+$cr = new KmersFileCreator(0xfeedface, 8, 0, [4]);
+$cr->set_format_version(2);
+$cr->set_packed_keys(1);
+$cr->open_file($file);
+$cr->write_file_header();
+$cr->write_entry($big[$_], [$_]) for 0..$#big;
+$cr->close_file();
+my ($kn, $kb) = (new KmersC(), new KmersC());
+$kn->open_data($file, "numa");
+$kb->open_data($file);
+my ($ln, $lb2) = ([], []);
+$kn->find_motif_hits(\@probes, $ln);
+$kb->find_motif_hits(\@probes, $lb2);
+is_deeply([scalar(grep { $_->[2] == $_->[0] } @$ln), $ln], [scalar(@big), $lb2], "NUMA replica lookups match the base table");
+unlink $file;
@@ -1,5 +1,7 @@
 
 #include "table.h"
+#include "motif_key.h"
+#include "hash.h"
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
@@ -10,8 +12,252 @@
 #include <sys/mman.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#define PREFIX_UNKNOWN UINT32_MAX
+
+static void init_prefix_index(struct motif_table *tbl);
+static void replicate_table(struct motif_table *tbl);
+static int attach_table(struct motif_table *table);
+static void read_header_v1(struct motif_table *table);
+static int read_header_v2(struct motif_table *table);
+static int map_attrs(struct motif_table *table);
+static int map_tuples(struct motif_table *table);
+static int map_tombstones(struct motif_table *table);
+static int map_index(struct motif_table *tbl, const char *suffix, uint32_t magic,
+		     struct table_sidecar *sc, const void **data, size_t *size);
 
 int map_table(char *file, struct motif_table *table)
+{
+    return map_table_opts(file, table, 0);
+}
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The default huge page size, from /proc/meminfo, or 2 MiB.
+ */
+static size_t huge_page_size()
+{
+    static size_t size;
+    if (size == 0)
+    {
+	size = 2 << 20;
+	FILE *fp = fopen("/proc/meminfo", "r");
+	if (fp)
+	{
+	    char line[256];
+	    unsigned long kb;
+	    while (fgets(line, sizeof(line), fp))
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+		{
+		    size = kb << 10;
+		    break;
+		}
+	    fclose(fp);
+	}
+    }
+    return size;
+}
+
+/*
+ * Whether any of the anonymous mapping at address is in transparent
+ * huge pages, according to /proc/self/smaps.
+ */
+static int thp_backed(void *address)
+{
+    FILE *fp = fopen("/proc/self/smaps", "r");
+    if (!fp)
+	return 0;
+    char line[512];
+    int found = 0, backed = 0;
+    unsigned long start, end, kb;
+    while (fgets(line, sizeof(line), fp))
+    {
+	if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+	{
+	    if (found)
+		break;
+	    found = start == (unsigned long) address;
+	}
+	else if (found && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+	{
+	    backed = kb > 0;
+	    break;
+	}
+    }
+    fclose(fp);
+    return backed;
+}
+
+/*
+ * Read size bytes of fd from its start into ptr.
+ */
+static int read_fully(int fd, char *ptr, size_t size, const char *name)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+	ssize_t n = pread(fd, ptr + done, size - done, done);
+	if (n <= 0)
+	{
+	    fprintf(stderr, "Error reading %s: %s\n", name, n < 0 ? strerror(errno) : "unexpected end of file");
+	    return 0;
+	}
+	done += n;
+    }
+    return 1;
+}
+
+/*
+ * Map len bytes (a multiple of the huge page size) of anonymous memory
+ * in explicit huge pages, setting *page_size, or failing that aligned
+ * and advised for transparent huge pages, leaving *page_size alone.
+ */
+static char *map_huge_pages(size_t len, const char *name, size_t *page_size)
+{
+    size_t huge = huge_page_size();
+    char *ptr = (char *) mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED)
+    {
+	*page_size = huge;
+	return ptr;
+    }
+
+    /*
+     * Over-allocate to align the memory on a huge page boundary, where
+     * the kernel can back it with transparent huge pages.
+     */
+    char *raw = (char *) mmap(0, len + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+	return raw;
+    ptr = (char *) (((uintptr_t) raw + huge - 1) & ~(uintptr_t) (huge - 1));
+    if (ptr > raw)
+	munmap(raw, ptr - raw);
+    munmap(ptr + len, raw + huge - ptr);
+    if (madvise(ptr, len, MADV_HUGEPAGE) != 0)
+	fprintf(stderr, "%s: transparent huge pages unavailable: %s\n", name, strerror(errno));
+    return ptr;
+}
+
+/*
+ * Copy size bytes of fd into anonymous memory in huge pages where
+ * possible, setting *page_size to the page size obtained.
+ */
+static void *copy_to_huge_pages(int fd, size_t size, const char *name, size_t *page_size)
+{
+    size_t huge = huge_page_size();
+    size_t len = (size + huge - 1) & ~(huge - 1);
+    char *ptr = map_huge_pages(len, name, page_size);
+    if (ptr == MAP_FAILED)
+	return ptr;
+
+    if (!read_fully(fd, ptr, size, name))
+    {
+	munmap(ptr, len);
+	return MAP_FAILED;
+    }
+    if (mprotect(ptr, len, PROT_READ) != 0)
+    {
+	fprintf(stderr, "%s: mprotect failed: %s\n", name, strerror(errno));
+	munmap(ptr, len);
+	return MAP_FAILED;
+    }
+
+    if (*page_size != huge)
+	*page_size = thp_backed(ptr) ? huge : (size_t) sysconf(_SC_PAGESIZE);
+    return ptr;
+}
+
+void *map_resident(int fd, size_t size, int *opts, const char *name, double *seconds,
+		   size_t *page_size)
+{
+    double start = now_seconds();
+    size_t psize = 0;
+    void *ptr = MAP_FAILED;
+    if (*opts & MOTIF_MAP_HUGE)
+    {
+	ptr = copy_to_huge_pages(fd, size, name, &psize);
+	if (ptr == MAP_FAILED)
+	{
+	    fprintf(stderr, "%s: cannot copy into huge pages, mapping the file instead\n", name);
+	    *opts &= ~MOTIF_MAP_HUGE;
+	}
+    }
+    if (!(*opts & MOTIF_MAP_HUGE))
+    {
+	ptr = mmap(0, size, PROT_READ, MAP_SHARED | (*opts & MOTIF_MAP_POPULATE ? MAP_POPULATE : 0), fd, 0);
+	psize = sysconf(_SC_PAGESIZE);
+    }
+    if (ptr == MAP_FAILED)
+	return ptr;
+    if ((*opts & MOTIF_MAP_RANDOM) && madvise(ptr, size, MADV_RANDOM) != 0)
+	fprintf(stderr, "%s: madvise(MADV_RANDOM) failed: %s\n", name, strerror(errno));
+    if ((*opts & MOTIF_MAP_WILLNEED) && madvise(ptr, size, MADV_WILLNEED) != 0)
+	fprintf(stderr, "%s: madvise(MADV_WILLNEED) failed: %s\n", name, strerror(errno));
+    if ((*opts & MOTIF_MAP_LOCK) && mlock(ptr, size) != 0)
+	fprintf(stderr, "%s: mlock failed: %s\n", name, strerror(errno));
+    *seconds += now_seconds() - start;
+    if (page_size)
+	*page_size = psize;
+    return ptr;
+}
+
+void unmap_resident(void *address, size_t size, int opts)
+{
+    if (opts & MOTIF_MAP_HUGE)
+    {
+	size_t huge = huge_page_size();
+	size = (size + huge - 1) & ~(huge - 1);
+    }
+    munmap(address, size);
+}
+
+int parse_map_opts(const char *spec, int *opts)
+{
+    static const struct { const char *name; int opt; } names[] = {
+	{ "lazy", 0 },
+	{ "populate", MOTIF_MAP_POPULATE },
+	{ "willneed", MOTIF_MAP_WILLNEED },
+	{ "random", MOTIF_MAP_RANDOM },
+	{ "mlock", MOTIF_MAP_LOCK },
+	{ "hugepages", MOTIF_MAP_HUGE },
+	{ "numa", MOTIF_MAP_NUMA },
+    };
+    *opts = 0;
+    while (*spec)
+    {
+	size_t len = strcspn(spec, ",");
+	size_t i;
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+	    if (strlen(names[i].name) == len && strncmp(spec, names[i].name, len) == 0)
+		break;
+	if (i == sizeof(names) / sizeof(names[0]))
+	{
+	    fprintf(stderr, "unknown residency option %.*s\n", (int) len, spec);
+	    return 0;
+	}
+	*opts |= names[i].opt;
+	spec += len;
+	if (*spec == ',')
+	    spec++;
+    }
+    return 1;
+}
+
+int map_table_opts(char *file, struct motif_table *table, int opts)
 {
     int fd = open(file, O_RDONLY);
     if (fd < 0)
@@ -19,66 +265,1125 @@ int map_table(char *file, struct motif_table *table)
 	fprintf(stderr, "Error opening %s: %s\n", file, strerror(errno));
 	return 0;
     }
+    return map_table_fd(fd, file, table, opts);
+}
 
-    memset(table, 0, sizeof(table));
+int map_table_fd(int fd, char *file, struct motif_table *table, int opts)
+{
+    memset(table, 0, sizeof(*table));
     strncpy(table->mapped_file, file, sizeof(table->mapped_file));
     
     struct stat s;
     if (fstat(fd, &s) != 0)
     {
-	perror("stat failed");
-	exit(1);
+	fprintf(stderr, "Error opening %s: %s\n", file, strerror(errno));
+	close(fd);
+	return 0;
     }
     // printf("Mapping file size %zd\n", s.st_size);
-    void *ptr = mmap(0, s.st_size, PROT_READ, MAP_SHARED, fd, 0);
-    if (ptr == 0)
+    void *ptr = map_resident(fd, s.st_size, &opts, file, &table->warmup_seconds, &table->page_size);
+    table->map_opts = opts;
+    if (ptr == MAP_FAILED)
     {
-	perror("mmap failed");
-	exit(1);
+	fprintf(stderr, "Error mapping %s: %s\n", file, strerror(errno));
+	close(fd);
+	return 0;
     }
 
     table->mapped_address = ptr;
     table->mapped_size = s.st_size;
+    table->mapped_mtime = (int64_t) s.st_mtim.tv_sec * 1000000000 + s.st_mtim.tv_nsec;
+    table->mapped_fd = fd;
+
+    int ok = attach_table(table);
+    if (ok && (opts & MOTIF_MAP_NUMA))
+    {
+	double start = now_seconds();
+	replicate_table(table);
+	table->warmup_seconds += now_seconds() - start;
+    }
+    if (ok && opts)
+	fprintf(stderr, "%s: warm-up took %.3f s, %zu KiB pages\n", file, table->warmup_seconds,
+		table->page_size >> 10);
+    return ok;
+}
 
-    struct motif_table_header *raw_header = (struct motif_table_header *) ptr;
+int map_table_image(struct motif_table *table, const char *name, void *address, size_t size)
+{
+    memset(table, 0, sizeof(*table));
+    strncpy(table->mapped_file, name, sizeof(table->mapped_file) - 1);
+    table->mapped_fd = -1;
+    table->mapped_address = address;
+    table->mapped_size = size;
+    if (size < sizeof(struct motif_table_header_v2) ||
+	memcmp(address, MOTIF_TABLE_V2_SIGNATURE, 8) != 0)
+    {
+	fprintf(stderr, "%s: not a version 2 table\n", name);
+	return 0;
+    }
+    return attach_table(table);
+}
+
+static uint64_t native_key_at(const char *entry)
+{
+    uint64_t key;
+    memcpy(&key, entry, sizeof(key));
+    return key;
+}
+
+static uint64_t big_endian_key_at(const char *entry)
+{
+    uint64_t key;
+    memcpy(&key, entry, sizeof(key));
+    return be64toh(key);
+}
+
+/*
+ * Read the header of the table at mapped_address and set up its indexes.
+ */
+static int attach_table(struct motif_table *table)
+{
+    const char *file = table->mapped_file;
+    if (table->mapped_size >= sizeof(struct motif_table_header_v2) &&
+	memcmp(table->mapped_address, MOTIF_TABLE_V2_SIGNATURE, 8) == 0)
+    {
+	if (!read_header_v2(table))
+	{
+	    unmap_table(table);
+	    return 0;
+	}
+    }
+    else
+	read_header_v1(table);
+
+    if (table->header.flags & MOTIF_TABLE_PACKED_KEYS)
+	table->key_len = sizeof(uint64_t);
+    else
+	table->key_len = table->header.motif_len;
+    table->key_at = table->version >= 2 ? native_key_at : big_endian_key_at;
+
+    if (!map_attrs(table) || !map_tombstones(table))
+    {
+	unmap_table(table);
+	return 0;
+    }
+    
+    fprintf(stderr, "mapped table v%d, motif_len=%d pad_len=%d num_attrs=%d data_entry_len=%d len=%lu flags=%x\n",
+	    table->version, table->header.motif_len, table->header.pad_len,
+	    table->header.num_attrs, table->header.data_entry_len, table->len, table->header.flags);
 
     /*
-     * Byteswap the header.
+     * A cuckoo table or one with encoded keys is its own index; the
+     * sorted-order ones do not apply.
      */
+    if (table->header.flags & (MOTIF_TABLE_CUCKOO | MOTIF_TABLE_ENCODED_KEYS))
+    {
+	set_search_method(table, SEARCH_AUTO);
+	return 1;
+    }
+
+    init_prefix_index(table);
+
+    /*
+     * The indexes holding 32-bit entry numbers cannot address a large
+     * table, which is searched through the others.
+     */
+    int large = is_large_table(table);
+    if (large)
+	fprintf(stderr, "%s: large table, not using eytzinger, s-tree or perfect hash indexes\n", file);
+
+    const void *data;
+    size_t size;
+    if (!large && map_index(table, EYTZINGER_SUFFIX, EYTZINGER_MAGIC, &table->eytz_map, &data, &size))
+    {
+	if (eytzinger_load(&table->eytz, data, size) && table->eytz.count == table->len)
+	    fprintf(stderr, "mapped eytzinger index for %s\n", file);
+	else
+	{
+	    memset(&table->eytz, 0, sizeof(table->eytz));
+	    unmap_sidecar(&table->eytz_map);
+	}
+    }
+    if (!large && map_index(table, STREE_SUFFIX, STREE_MAGIC, &table->stree_map, &data, &size))
+    {
+	if (stree_load(&table->stree, data, size) && table->stree.count == table->len)
+	    fprintf(stderr, "mapped s-tree index for %s (%s)\n", file,
+		    table->stree.use_avx2 ? "avx2" : "scalar");
+	else
+	{
+	    memset(&table->stree, 0, sizeof(table->stree));
+	    unmap_sidecar(&table->stree_map);
+	}
+    }
+
+    if (map_index(table, BLOOM_SUFFIX, BLOOM_MAGIC, &table->bloom_map, &data, &size))
+    {
+	if (bloom_load(&table->bloom, data, size))
+	    fprintf(stderr, "mapped bloom filter for %s\n", file);
+	else
+	{
+	    memset(&table->bloom, 0, sizeof(table->bloom));
+	    unmap_sidecar(&table->bloom_map);
+	}
+    }
+
+    if (!large && map_index(table, MPHF_SUFFIX, MPHF_MAGIC, &table->mphf_map, &data, &size))
+    {
+	if (mphf_load(&table->mphf, data, size) && table->mphf.count == table->len)
+	    fprintf(stderr, "mapped perfect hash index for %s\n", file);
+	else
+	{
+	    memset(&table->mphf, 0, sizeof(table->mphf));
+	    unmap_sidecar(&table->mphf_map);
+	}
+    }
+
+    if (map_index(table, PGM_SUFFIX, PGM_MAGIC, &table->pgm_map, &data, &size))
+    {
+	if (pgm_load(&table->pgm, data, size) && table->pgm.count == table->len)
+	    fprintf(stderr, "mapped learned index for %s (%lu segments)\n", file,
+		    (unsigned long) table->pgm.level_count[0]);
+	else
+	{
+	    memset(&table->pgm, 0, sizeof(table->pgm));
+	    unmap_sidecar(&table->pgm_map);
+	}
+    }
+
+    set_search_method(table, SEARCH_AUTO);
+    
+    return 1;
+}
+
+/*
+ * Byteswap a version 1 header.
+ */
+static void read_header_v1(struct motif_table *table)
+{
+    struct motif_table_header *raw_header = (struct motif_table_header *) table->mapped_address;
+
+    table->version = 1;
     table->header.magic = ntohl(raw_header->magic);
     table->header.motif_len = ntohl(raw_header->motif_len);
     table->header.pad_len = ntohl(raw_header->pad_len);
     table->header.num_attrs = ntohl(raw_header->num_attrs);
     table->header.data_entry_len = ntohl(raw_header->data_entry_len);
+    table->header.flags = ntohl(raw_header->flags);
     int i;
-    for (i = 0; i < 32; i++)
+    for (i = 0; i < MOTIF_MAX_ATTRS; i++)
 	table->header.attr_len[i] = ntohl(raw_header->attr_len[i]);
     
-    table->table = (char *) ptr + sizeof(struct motif_table_header);
+    size_t offset = table_data_offset(table->header.flags);
+    table->table = (char *) table->mapped_address + offset;
+    table->len = table->mapped_size > offset ? (table->mapped_size - offset) / table->header.data_entry_len : 0;
+}
+
+static int read_header_v2(struct motif_table *table)
+{
+    const struct motif_table_header_v2 *hdr = (const struct motif_table_header_v2 *) table->mapped_address;
+
+    if (hdr->version != 2 || hdr->nsections > MOTIF_MAX_SECTIONS ||
+	hdr->num_attrs < 0 || hdr->num_attrs > MOTIF_MAX_ATTRS || hdr->data_entry_len <= 0)
+    {
+	fprintf(stderr, "%s: unsupported version %u table header\n", table->mapped_file, hdr->version);
+	return 0;
+    }
+    uint32_t i;
+    for (i = 0; i < hdr->nsections; i++)
+    {
+	const struct motif_section *sec = &hdr->sections[i];
+	if (sec->offset % 64 || sec->offset > table->mapped_size ||
+	    sec->size > table->mapped_size - sec->offset)
+	{
+	    fprintf(stderr, "%s: section %u lies outside the file\n", table->mapped_file, i);
+	    return 0;
+	}
+    }
+
+    table->version = 2;
+    table->sections = hdr->sections;
+    table->nsections = hdr->nsections;
+    table->header.magic = hdr->magic;
+    table->header.motif_len = hdr->motif_len;
+    table->header.pad_len = hdr->pad_len;
+    table->header.num_attrs = hdr->num_attrs;
+    table->header.data_entry_len = hdr->data_entry_len;
+    table->header.flags = hdr->flags;
+    int a;
+    for (a = 0; a < MOTIF_MAX_ATTRS; a++)
+	table->header.attr_len[a] = hdr->attr_len[a];
+
+    const void *data;
+    size_t size;
+    if (hdr->flags & MOTIF_TABLE_FRONT_CODED)
+    {
+	if (!find_table_section(table, MOTIF_SECTION_FRONT_CODED, &data, &size) ||
+	    !frontcode_load(&table->fc, data, size) || table->fc.count != hdr->count ||
+	    table->fc.key_len != ((hdr->flags & MOTIF_TABLE_PACKED_KEYS) ? (int) sizeof(uint64_t) : hdr->motif_len))
+	{
+	    fprintf(stderr, "%s: missing or invalid front-coded keys\n", table->mapped_file);
+	    return 0;
+	}
+	table->table = 0;
+	table->len = hdr->count;
+	return 1;
+    }
+    if (hdr->flags & MOTIF_TABLE_ELIAS_FANO)
+    {
+	if (!(hdr->flags & MOTIF_TABLE_PACKED_KEYS) ||
+	    !find_table_section(table, MOTIF_SECTION_ELIAS_FANO, &data, &size) ||
+	    !ef_load(&table->ef, data, size) || table->ef.count != hdr->count)
+	{
+	    fprintf(stderr, "%s: missing or invalid Elias-Fano keys\n", table->mapped_file);
+	    return 0;
+	}
+	table->table = 0;
+	table->len = hdr->count;
+	return 1;
+    }
+    if (!find_table_section(table, MOTIF_SECTION_ENTRIES, &data, &size) ||
+	size != hdr->count * hdr->data_entry_len)
+    {
+	fprintf(stderr, "%s: missing or short entries section\n", table->mapped_file);
+	return 0;
+    }
+    table->table = (char *) data;
+    table->len = hdr->count;
+    return 1;
+}
+
+/*
+ * Map the tuple dictionary and the entries' tuple numbers.
+ */
+static int map_tuples(struct motif_table *table)
+{
+    if (table->header.num_attrs == 0)
+	return 1;
+
+    const void *data;
+    size_t size;
+    size_t tuple_size = table->header.num_attrs * sizeof(int32_t);
+    if (!find_table_section(table, MOTIF_SECTION_TUPLES, &data, &size) || size % tuple_size)
+    {
+	fprintf(stderr, "%s: missing or invalid attribute dictionary\n", table->mapped_file);
+	return 0;
+    }
+    table->tuples = (const int32_t *) data;
+    table->ntuples = size / tuple_size;
+
+    if (!find_table_section(table, MOTIF_SECTION_TUPLE_IDS, &data, &size) ||
+	!bitpack_load(&table->tuple_ids, data, size) || table->tuple_ids.count != table->len ||
+	(table->len && table->ntuples == 0))
+    {
+	fprintf(stderr, "%s: missing or invalid attribute dictionary numbers\n", table->mapped_file);
+	return 0;
+    }
+
+    /*
+     * Every tuple number must index the dictionary. When the packed
+     * width allows numbers past its end, check each one.
+     */
+    const struct bitpack_column *ids = &table->tuple_ids;
+    int ok = ids->base >= 0;
+    if (ok && (uint64_t) ids->base + ids->mask >= table->ntuples)
+    {
+	unsigned long n;
+	for (n = 0; ok && n < table->len; n++)
+	    ok = (uint64_t) bitpack_get(ids, n) < table->ntuples;
+    }
+    if (!ok)
+    {
+	fprintf(stderr, "%s: attribute dictionary number out of range\n", table->mapped_file);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Locate each attribute, in its own column or within the rows.
+ */
+static int map_attrs(struct motif_table *table)
+{
+    if (table->header.num_attrs < 0 || table->header.num_attrs > MOTIF_MAX_ATTRS)
+    {
+	fprintf(stderr, "%s: invalid attribute count %d\n", table->mapped_file, table->header.num_attrs);
+	return 0;
+    }
+    if ((table->header.flags & MOTIF_TABLE_BITPACKED) && !(table->header.flags & MOTIF_TABLE_COLUMNAR))
+    {
+	fprintf(stderr, "%s: bit-packed attributes without columns\n", table->mapped_file);
+	return 0;
+    }
+
+    if (table->header.flags & MOTIF_TABLE_DICTIONARY)
+	return map_tuples(table);
+
+    /*
+     * Encoded keys have no rows to hold attributes in.
+     */
+    if ((table->header.flags & MOTIF_TABLE_ENCODED_KEYS) && table->header.num_attrs > 0 &&
+	!(table->header.flags & MOTIF_TABLE_COLUMNAR))
+    {
+	fprintf(stderr, "%s: encoded keys with row attributes\n", table->mapped_file);
+	return 0;
+    }
+
+    int i;
+    int offset = table->key_len;
+    for (i = 0; i < table->header.num_attrs; i++)
+    {
+	if (table->header.flags & MOTIF_TABLE_COLUMNAR)
+	{
+	    const void *data;
+	    size_t size;
+	    int ok = find_table_section(table, MOTIF_SECTION_ATTRS + i, &data, &size);
+	    if (ok && (table->header.flags & MOTIF_TABLE_BITPACKED))
+		ok = bitpack_load(&table->packed_attr[i], data, size) &&
+		    table->packed_attr[i].count == table->len;
+	    else if (ok)
+	    {
+		ok = size == table->len * table->header.attr_len[i];
+		table->attr_column[i] = (const char *) data;
+	    }
+	    if (!ok)
+	    {
+		fprintf(stderr, "%s: missing or short column for attribute %d\n", table->mapped_file, i);
+		return 0;
+	    }
+	}
+	else
+	{
+	    table->attr_offset[i] = offset;
+	    offset += table->header.attr_len[i];
+	}
+    }
+    return 1;
+}
+
+static int map_tombstones(struct motif_table *table)
+{
+    if (!(table->header.flags & MOTIF_TABLE_DELTA))
+	return 1;
+    const void *data;
+    size_t size;
+    if (table->version < 2 || (table->header.flags & (MOTIF_TABLE_CUCKOO | MOTIF_TABLE_ENCODED_KEYS)) ||
+	!find_table_section(table, MOTIF_SECTION_TOMBSTONES, &data, &size) ||
+	size != (table->len + 63) / 64 * sizeof(uint64_t))
+    {
+	fprintf(stderr, "%s: invalid delta table\n", table->mapped_file);
+	return 0;
+    }
+    table->tombstones = (const uint64_t *) data;
+    return 1;
+}
+
+int get_attr_value(struct motif_table *tbl, unsigned long n, int i)
+{
+    if (tbl->header.flags & MOTIF_TABLE_DICTIONARY)
+	return tbl->tuples[tbl->header.num_attrs * (uint64_t) bitpack_get(&tbl->tuple_ids, n) + i];
+    if (tbl->header.flags & MOTIF_TABLE_BITPACKED)
+	return bitpack_get(&tbl->packed_attr[i], n);
+
+    const char *ptr;
+    if (tbl->attr_column[i])
+	ptr = tbl->attr_column[i] + n * tbl->header.attr_len[i];
+    else
+	ptr = get_motif_at(tbl, n) + tbl->attr_offset[i];
+
+    switch (tbl->header.attr_len[i])
+    {
+    case 1:
+	return (int) *ptr;
+
+    case 2:
+    {
+	unsigned short sv;
+	memcpy(&sv, ptr, sizeof(sv));
+	return tbl->version >= 2 ? sv : ntohs(sv);
+    }
+
+    case 4:
+    {
+	int v;
+	memcpy(&v, ptr, sizeof(v));
+	return tbl->version >= 2 ? v : (int) ntohl(v);
+    }
+    }
+    return 0;
+}
+
+int find_table_section(struct motif_table *tbl, uint32_t type, const void **data, size_t *size)
+{
+    int i;
+    for (i = 0; i < tbl->nsections; i++)
+    {
+	if (tbl->sections[i].type == type)
+	{
+	    *data = (const char *) tbl->mapped_address + tbl->sections[i].offset;
+	    *size = tbl->sections[i].size;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * Find an index in the table's own sections, or else in its sidecar
+ * (unless the table is an image within another file).
+ */
+static int map_index(struct motif_table *tbl, const char *suffix, uint32_t magic,
+		     struct table_sidecar *sc, const void **data, size_t *size)
+{
+    if (find_table_section(tbl, magic, data, size))
+	return 1;
+    if (tbl->mapped_fd < 0)
+	return 0;
+    return map_sidecar(tbl, suffix, magic, sc, data, size);
+}
+
+/*
+ * A table in the registry of acquire_table. While loading, the table
+ * is being mapped without the lock held; failed marks an entry whose
+ * mapping failed, already taken off the list, that is freed by the last
+ * thread waiting on it.
+ */
+struct shared_table
+{
+    struct motif_table table;
+    dev_t dev;
+    ino_t ino;
+    int64_t mtime;
+    int opts;
+    int refs;
+    int loading;
+    int failed;
+    struct shared_table *next;
+};
+
+static struct shared_table *shared_tables;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shared_loaded = PTHREAD_COND_INITIALIZER;
+
+int acquire_table(char *file, struct motif_table *table, int opts)
+{
+    /*
+     * The file is opened once and the registry key taken from that
+     * descriptor, so a file renamed over the path in the meantime cannot
+     * be mapped under the key of the one it replaced.
+     */
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+    {
+	fprintf(stderr, "Error opening %s: %s\n", file, strerror(errno));
+	return 0;
+    }
+    struct stat s;
+    if (fstat(fd, &s) != 0)
+    {
+	fprintf(stderr, "Error opening %s: %s\n", file, strerror(errno));
+	close(fd);
+	return 0;
+    }
+    int64_t mtime = (int64_t) s.st_mtim.tv_sec * 1000000000 + s.st_mtim.tv_nsec;
+
+    pthread_mutex_lock(&shared_lock);
+    struct shared_table *sh;
+    for (sh = shared_tables; sh; sh = sh->next)
+	if (sh->dev == s.st_dev && sh->ino == s.st_ino && sh->mtime == mtime && sh->opts == opts)
+	    break;
+    if (sh)
+    {
+	/*
+	 * The reference keeps the entry alive while we wait for another
+	 * thread to finish mapping it.
+	 */
+	close(fd);
+	sh->refs++;
+	while (sh->loading)
+	    pthread_cond_wait(&shared_loaded, &shared_lock);
+	if (sh->failed)
+	{
+	    int last = --sh->refs == 0;
+	    pthread_mutex_unlock(&shared_lock);
+	    if (last)
+		free(sh);
+	    return 0;
+	}
+	*table = sh->table;
+	table->warmup_seconds = 0;
+    }
+    else
+    {
+	sh = (struct shared_table *) calloc(1, sizeof(*sh));
+	if (sh == 0)
+	{
+	    pthread_mutex_unlock(&shared_lock);
+	    close(fd);
+	    return 0;
+	}
+	sh->dev = s.st_dev;
+	sh->ino = s.st_ino;
+	sh->mtime = mtime;
+	sh->opts = opts;
+	sh->refs = 1;
+	sh->loading = 1;
+	sh->next = shared_tables;
+	shared_tables = sh;
+	pthread_mutex_unlock(&shared_lock);
+
+	int ok = map_table_fd(fd, file, &sh->table, opts);
+
+	pthread_mutex_lock(&shared_lock);
+	sh->loading = 0;
+	pthread_cond_broadcast(&shared_loaded);
+	if (!ok)
+	{
+	    struct shared_table **p;
+	    for (p = &shared_tables; *p != sh; p = &(*p)->next)
+		;
+	    *p = sh->next;
+	    sh->failed = 1;
+	    int last = --sh->refs == 0;
+	    pthread_mutex_unlock(&shared_lock);
+	    if (last)
+		free(sh);
+	    return 0;
+	}
+	sh->mtime = sh->table.mapped_mtime;
+	*table = sh->table;
+    }
+    table->shared = sh;
+    pthread_mutex_unlock(&shared_lock);
+    return 1;
+}
+
+int table_share_count(struct motif_table *table)
+{
+    if (!table->shared)
+	return 0;
+    pthread_mutex_lock(&shared_lock);
+    int refs = table->shared->refs;
+    pthread_mutex_unlock(&shared_lock);
+    return refs;
+}
+
+/*
+ * Drop a view from acquire_table, unmapping the table with its last view.
+ */
+static void release_table(struct motif_table *table)
+{
+    struct shared_table *sh = table->shared;
+    pthread_mutex_lock(&shared_lock);
+    if (--sh->refs == 0)
+    {
+	struct shared_table **p;
+	for (p = &shared_tables; *p != sh; p = &(*p)->next)
+	    ;
+	*p = sh->next;
+    }
+    else
+	sh = 0;
+    pthread_mutex_unlock(&shared_lock);
+    if (sh)
+    {
+	unmap_table(&sh->table);
+	free(sh);
+    }
+    memset(table, 0, sizeof(*table));
+    table->mapped_fd = -1;
+}
+
+/*
+ * Read the next range of a sysfs list such as "0-3,8,10-11" into
+ * [*first, *last]. Returns 0 at the end of the list.
+ */
+static int next_list_range(FILE *fp, int *first, int *last)
+{
+    char sep;
+    if (fscanf(fp, "%d", first) != 1)
+	return 0;
+    *last = *first;
+    if (fscanf(fp, "%c", &sep) == 1 && sep == '-' && fscanf(fp, "%d", last) == 1)
+	fscanf(fp, "%c", &sep);
+    return 1;
+}
+
+/*
+ * The highest online NUMA node, from sysfs, or 0.
+ */
+static int max_numa_node()
+{
+    int max = 0;
+    FILE *fp = fopen("/sys/devices/system/node/online", "r");
+    if (fp)
+    {
+	int a, b;
+	while (next_list_range(fp, &a, &b))
+	{
+	    if (b > max)
+		max = b;
+	}
+	fclose(fp);
+    }
+    return max;
+}
+
+static int node_online(int node)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+    struct stat s;
+    return node == 0 || stat(path, &s) == 0;
+}
+
+/*
+ * The node of each CPU, from the nodes' cpulists in sysfs, read on the
+ * first call to numa_node. CPUs not listed are taken to be on node 0.
+ */
+static int *cpu_nodes;
+static int ncpu_nodes;
+static pthread_once_t cpu_nodes_once = PTHREAD_ONCE_INIT;
+
+static void init_cpu_nodes()
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (ncpus <= 0)
+	return;
+    int *nodes = (int *) calloc(ncpus, sizeof(int));
+    if (nodes == 0)
+	return;
+    int max = max_numa_node();
+    int node;
+    for (node = 0; node <= max; node++)
+    {
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	FILE *fp = fopen(path, "r");
+	if (fp == 0)
+	    continue;
+	int a, b;
+	while (next_list_range(fp, &a, &b))
+	{
+	    int cpu;
+	    for (cpu = a; cpu <= b && cpu < ncpus; cpu++)
+		if (cpu >= 0)
+		    nodes[cpu] = node;
+	}
+	fclose(fp);
+    }
+    cpu_nodes = nodes;
+    ncpu_nodes = ncpus;
+}
+
+int numa_node()
+{
+    pthread_once(&cpu_nodes_once, init_cpu_nodes);
+    int cpu = sched_getcpu();
+    return cpu >= 0 && cpu < ncpu_nodes ? cpu_nodes[cpu] : 0;
+}
+
+/*
+ * Copy a version 2 table into anonymous memory on each online NUMA
+ * node. The memory policy is set before the copy touches the pages,
+ * so they are allocated on the node; MPOL_PREFERRED lets the kernel
+ * fall back to another node rather than fail when the node is full.
+ * With MOTIF_MAP_HUGE each copy is in huge pages, as the table is.
+ */
+static void replicate_table(struct motif_table *tbl)
+{
+    if (tbl->version < 2)
+    {
+	fprintf(stderr, "%s: only version 2 tables can be replicated across NUMA nodes\n", tbl->mapped_file);
+	return;
+    }
+    int nnodes = max_numa_node() + 1;
+    tbl->replicas = (struct motif_table **) calloc(nnodes, sizeof(*tbl->replicas));
+    if (tbl->replicas == 0)
+	return;
+    tbl->nreplicas = nnodes;
+
+    int node;
+    for (node = 0; node < nnodes; node++)
+    {
+	if (!node_online(node))
+	    continue;
+	size_t size = tbl->mapped_size;
+	size_t len = size;
+	size_t page_size = 0;
+	char *ptr;
+	if (tbl->map_opts & MOTIF_MAP_HUGE)
+	{
+	    size_t huge = huge_page_size();
+	    len = (size + huge - 1) & ~(huge - 1);
+	    ptr = map_huge_pages(len, tbl->mapped_file, &page_size);
+	}
+	else
+	    ptr = (char *) mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+	{
+	    fprintf(stderr, "%s: no memory for a replica on node %d\n", tbl->mapped_file, node);
+	    continue;
+	}
+	unsigned long mask[16] = { 0 };
+	const int mask_bits = 8 * sizeof(mask);
+	if (node < mask_bits)
+	{
+	    mask[node / (8 * sizeof(mask[0]))] = 1UL << (node % (8 * sizeof(mask[0])));
+	    if (syscall(SYS_mbind, ptr, len, MPOL_PREFERRED, mask, mask_bits + 1, 0) != 0)
+		fprintf(stderr, "%s: cannot place replica on node %d: %s\n", tbl->mapped_file, node, strerror(errno));
+	}
+
+	char name[1100];
+	snprintf(name, sizeof(name), "%s[node %d]", tbl->mapped_file, node);
+	struct motif_table *rep = (struct motif_table *) malloc(sizeof(*rep));
+	int ok = rep && read_fully(tbl->mapped_fd, ptr, size, tbl->mapped_file);
+	if (ok && mprotect(ptr, len, PROT_READ) != 0)
+	{
+	    fprintf(stderr, "%s: mprotect failed: %s\n", name, strerror(errno));
+	    ok = 0;
+	}
+	if (ok)
+	    ok = map_table_image(rep, name, ptr, size);
+	if (!ok)
+	{
+	    free(rep);
+	    unmap_resident(ptr, size, tbl->map_opts);
+	    continue;
+	}
+	tbl->replicas[node] = rep;
+    }
+}
+
+static void unmap_replicas(struct motif_table *tbl)
+{
+    int node;
+    for (node = 0; node < tbl->nreplicas; node++)
+    {
+	struct motif_table *rep = tbl->replicas[node];
+	if (rep)
+	{
+	    void *ptr = rep->mapped_address;
+	    unmap_table(rep);
+	    unmap_resident(ptr, tbl->mapped_size, tbl->map_opts);
+	    free(rep);
+	}
+    }
+    free(tbl->replicas);
+    tbl->replicas = 0;
+    tbl->nreplicas = 0;
+}
+
+void unmap_table(struct motif_table *table)
+{
+    if (table->shared)
+    {
+	release_table(table);
+	return;
+    }
+    unmap_replicas(table);
+    unmap_sidecar(&table->eytz_map);
+    memset(&table->eytz, 0, sizeof(table->eytz));
+    unmap_sidecar(&table->stree_map);
+    memset(&table->stree, 0, sizeof(table->stree));
+    unmap_sidecar(&table->bloom_map);
+    memset(&table->bloom, 0, sizeof(table->bloom));
+    unmap_sidecar(&table->mphf_map);
+    memset(&table->mphf, 0, sizeof(table->mphf));
+    unmap_sidecar(&table->pgm_map);
+    memset(&table->pgm, 0, sizeof(table->pgm));
+
+    free(table->prefix_start);
+    table->prefix_start = 0;
+
+    if (table->mapped_fd >= 0)
+    {
+	unmap_resident(table->mapped_address, table->mapped_size, table->map_opts);
+	close(table->mapped_fd);
+    }
+    table->mapped_fd = -1;
+    table->mapped_address = 0;
+}
+
+int set_search_method(struct motif_table *tbl, int method)
+{
+    int resolved = method;
+    int cuckoo = (tbl->header.flags & MOTIF_TABLE_CUCKOO) != 0;
+    if (cuckoo && method != SEARCH_AUTO && method != SEARCH_CUCKOO)
+	return 0;
+    int front = (tbl->header.flags & MOTIF_TABLE_FRONT_CODED) != 0;
+    if (front && method != SEARCH_AUTO && method != SEARCH_FRONT_CODED)
+	return 0;
+    int ef = (tbl->header.flags & MOTIF_TABLE_ELIAS_FANO) != 0;
+    if (ef && method != SEARCH_AUTO && method != SEARCH_ELIAS_FANO)
+	return 0;
+    switch (method)
+    {
+    case SEARCH_AUTO:
+	if (cuckoo)
+	    resolved = SEARCH_CUCKOO;
+	else if (front)
+	    resolved = SEARCH_FRONT_CODED;
+	else if (ef)
+	    resolved = SEARCH_ELIAS_FANO;
+	else if (tbl->mphf.count)
+	    resolved = SEARCH_MPHF;
+	else if (tbl->stree.nblocks)
+	    resolved = SEARCH_STREE;
+	else if (tbl->eytz.count)
+	    resolved = SEARCH_EYTZINGER;
+	else if (tbl->pgm.nlevels)
+	    resolved = SEARCH_PGM;
+	else
+	    resolved = SEARCH_BINARY;
+	break;
+
+    case SEARCH_BINARY:
+	break;
+
+    case SEARCH_EYTZINGER:
+	if (tbl->eytz.count == 0)
+	    return 0;
+	break;
+
+    case SEARCH_STREE:
+	if (tbl->stree.nblocks == 0)
+	    return 0;
+	break;
+
+    case SEARCH_MPHF:
+	if (tbl->mphf.count == 0)
+	    return 0;
+	break;
+
+    case SEARCH_CUCKOO:
+	if (!cuckoo)
+	    return 0;
+	break;
+
+    case SEARCH_PGM:
+	if (tbl->pgm.nlevels == 0)
+	    return 0;
+	break;
+
+    case SEARCH_FRONT_CODED:
+	if (!front)
+	    return 0;
+	break;
+
+    case SEARCH_ELIAS_FANO:
+	if (!ef)
+	    return 0;
+	break;
+
+    default:
+	return 0;
+    }
+    tbl->search_method = method;
+    tbl->search = resolved;
+    return 1;
+}
+
+const char *search_method_name(int method)
+{
+    switch (method)
+    {
+    case SEARCH_AUTO:
+	return "auto";
+    case SEARCH_BINARY:
+	return "binary";
+    case SEARCH_EYTZINGER:
+	return "eytzinger";
+    case SEARCH_STREE:
+	return "stree";
+    case SEARCH_MPHF:
+	return "mphf";
+    case SEARCH_CUCKOO:
+	return "cuckoo";
+    case SEARCH_PGM:
+	return "pgm";
+    case SEARCH_FRONT_CODED:
+	return "frontcoded";
+    case SEARCH_ELIAS_FANO:
+	return "eliasfano";
+    }
+    return 0;
+}
+
+uint64_t entry_hash(struct motif_table *tbl, unsigned long n)
+{
+    if (tbl->header.flags & MOTIF_TABLE_PACKED_KEYS)
+	return hash_key(get_key_at(tbl, n));
+    else
+	return hash_motif(get_motif_at(tbl, n), tbl->header.motif_len);
+}
+
+static void init_prefix_index(struct motif_table *tbl)
+{
+    if (tbl->len == 0 || is_large_table(tbl))
+	return;
+
+    int bits;
+    if (tbl->header.flags & MOTIF_TABLE_PACKED_KEYS)
+    {
+	tbl->prefix_len = tbl->header.motif_len < 3 ? tbl->header.motif_len : 3;
+	bits = tbl->prefix_len * RESIDUE_BITS;
+    }
+    else
+    {
+	tbl->prefix_len = tbl->header.motif_len < 2 ? tbl->header.motif_len : 2;
+	bits = tbl->prefix_len * 8;
+    }
+
+    tbl->prefix_buckets = 1UL << bits;
+    tbl->prefix_start = (uint32_t *) malloc((tbl->prefix_buckets + 1) * sizeof(uint32_t));
+    if (tbl->prefix_start == 0)
+	return;
+    memset(tbl->prefix_start, 0xff, tbl->prefix_buckets * sizeof(uint32_t));
+    tbl->prefix_start[tbl->prefix_buckets] = tbl->len;
+}
+
+static unsigned long key_bucket(struct motif_table *tbl, uint64_t key)
+{
+    return key >> ((tbl->header.motif_len - tbl->prefix_len) * RESIDUE_BITS);
+}
+
+static unsigned long motif_bucket(struct motif_table *tbl, const char *motif)
+{
+    const unsigned char *m = (const unsigned char *) motif;
+    return tbl->prefix_len == 2 ? (m[0] << 8) | m[1] : m[0];
+}
+
+static unsigned long entry_bucket(struct motif_table *tbl, unsigned long n)
+{
+    if (tbl->header.flags & MOTIF_TABLE_PACKED_KEYS)
+	return key_bucket(tbl, get_key_at(tbl, n));
+    else
+	return motif_bucket(tbl, get_motif_at(tbl, n));
+}
+
+/*
+ * Return the first entry in bucket b or later, searching for it the
+ * first time the bucket is used. Racing threads store the same value.
+ */
+static unsigned long bucket_start(struct motif_table *tbl, unsigned long b)
+{
+    uint32_t s = __atomic_load_n(&tbl->prefix_start[b], __ATOMIC_RELAXED);
+    if (s != PREFIX_UNKNOWN)
+	return s;
+
+    unsigned long beg = 0;
+    unsigned long end = tbl->len;
+    while (beg < end)
+    {
+	unsigned long mid = (beg + end) / 2;
+	if (entry_bucket(tbl, mid) < b)
+	    beg = mid + 1;
+	else
+	    end = mid;
+    }
+    __atomic_store_n(&tbl->prefix_start[b], (uint32_t) beg, __ATOMIC_RELAXED);
+    return beg;
+}
+
+static void sidecar_path(struct motif_table *tbl, const char *suffix, char *path, size_t len)
+{
+    snprintf(path, len, "%s%s", tbl->mapped_file, suffix);
+}
+
+int write_sidecar(struct motif_table *tbl, const char *suffix, uint32_t magic,
+		  const void *data, size_t size)
+{
+    char path[1100], tmp[1110];
+    sidecar_path(tbl, suffix, path, sizeof(path));
+
+    /*
+     * Other processes may have the old sidecar mapped, so it is replaced
+     * by renaming a new file over it rather than rewritten.
+     */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (fp == 0)
+    {
+	fprintf(stderr, "Error opening %s: %s\n", tmp, strerror(errno));
+	return 0;
+    }
+
+    struct sidecar_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = magic;
+    hdr.version = 1;
+    hdr.table_size = tbl->mapped_size;
+    hdr.table_mtime = tbl->mapped_mtime;
+
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+	fwrite(data, 1, size, fp) == size &&
+	fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0)
+	ok = 0;
+    if (ok && rename(tmp, path) != 0)
+	ok = 0;
+    if (!ok)
+    {
+	fprintf(stderr, "Error writing %s: %s\n", path, strerror(errno));
+	unlink(tmp);
+    }
+    return ok;
+}
+
+int map_sidecar(struct motif_table *tbl, const char *suffix, uint32_t magic,
+		struct table_sidecar *sc, const void **data, size_t *size)
+{
+    char path[1100];
+    sidecar_path(tbl, suffix, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return 0;
+
+    struct stat s;
+    if (fstat(fd, &s) != 0 || s.st_size < (off_t) sizeof(struct sidecar_header))
+    {
+	close(fd);
+	return 0;
+    }
+
+    int opts = tbl->map_opts;
+    void *ptr = map_resident(fd, s.st_size, &opts, path, &tbl->warmup_seconds, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+    {
+	fprintf(stderr, "Error mapping %s: %s\n", path, strerror(errno));
+	return 0;
+    }
 
-    table->len = (s.st_size - sizeof(struct motif_table_header)) / table->header.data_entry_len;
-    table->mapped_fd = fd;
-    
-    fprintf(stderr, "mapped table, motif_len=%d pad_len=%d num_attrs=%d data_entry_len=%d len=%d\n",
-	    table->header.motif_len, table->header.pad_len, table->header.num_attrs,
-	    table->header.data_entry_len, table->len);
-    
+    struct sidecar_header *hdr = (struct sidecar_header *) ptr;
+    if (hdr->magic != magic || hdr->version != 1 ||
+	hdr->table_size != tbl->mapped_size || hdr->table_mtime != tbl->mapped_mtime)
+    {
+	fprintf(stderr, "Ignoring %s: not built from this table\n", path);
+	unmap_resident(ptr, s.st_size, opts);
+	return 0;
+    }
+
+    sc->map_opts = opts;
+    sc->address = ptr;
+    sc->size = s.st_size;
+    *data = (char *) ptr + sizeof(struct sidecar_header);
+    *size = s.st_size - sizeof(struct sidecar_header);
     return 1;
 }
 
-void unmap_table(struct motif_table *table)
+void unmap_sidecar(struct table_sidecar *sc)
 {
-    if (table->mapped_address)
+    if (sc->address)
     {
-	munmap(table->mapped_address, table->mapped_size);
-	close(table->mapped_fd);
-
-	table->mapped_fd = -1;
-	table->mapped_address = 0;
+	unmap_resident(sc->address, sc->size, sc->map_opts);
+	sc->address = 0;
+	sc->size = 0;
     }
 }
 
-int write_file_header(FILE *fp, int magic, int motif_len, int pad_len, int attr_len[32], int num_attrs)
+int write_file_header(FILE *fp, int magic, int motif_len, int pad_len, int attr_len[MOTIF_MAX_ATTRS], int num_attrs, int flags)
 {
     struct motif_table_header hdr;
     memset(&hdr, 0, sizeof(hdr));
@@ -88,7 +1393,7 @@ int write_file_header(FILE *fp, int magic, int motif_len, int pad_len, int attr_
     hdr.pad_len = htonl(pad_len);
     int i;
     int sz = 0;
-    for (i = 0; i < 32; i++)
+    for (i = 0; i < MOTIF_MAX_ATTRS; i++)
     {
 	if (i < num_attrs)
 	{
@@ -99,13 +1404,163 @@ int write_file_header(FILE *fp, int magic, int motif_len, int pad_len, int attr_
 	    hdr.attr_len[i] = htonl(0);
     }
     hdr.num_attrs = htonl(num_attrs);
-    int del = motif_len + pad_len + sz;
+    hdr.flags = htonl(flags);
+    int key_len = (flags & MOTIF_TABLE_PACKED_KEYS) ? sizeof(uint64_t) : motif_len;
+    int del = key_len + pad_len + sz;
     hdr.data_entry_len = htonl(del);
     return fwrite(&hdr, sizeof(hdr), 1, fp);
 }
 
-int find_in_range(struct motif_table *tbl, char *motif, unsigned long start, unsigned long len)
+void init_file_header_v2(struct motif_table_header_v2 *hdr, int magic, int motif_len, int pad_len,
+			 int attr_len[MOTIF_MAX_ATTRS], int num_attrs, int flags)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->signature, MOTIF_TABLE_V2_SIGNATURE, sizeof(hdr->signature));
+    hdr->version = 2;
+    hdr->magic = magic;
+    hdr->motif_len = motif_len;
+    hdr->pad_len = pad_len;
+    hdr->num_attrs = num_attrs;
+    hdr->flags = flags;
+    int i;
+    int sz = 0;
+    for (i = 0; i < num_attrs; i++)
+    {
+	hdr->attr_len[i] = attr_len[i];
+	sz += attr_len[i];
+    }
+    int key_len = (flags & MOTIF_TABLE_PACKED_KEYS) ? sizeof(uint64_t) : motif_len;
+    if (flags & (MOTIF_TABLE_COLUMNAR | MOTIF_TABLE_DICTIONARY))
+	hdr->data_entry_len = key_len + pad_len;
+    else
+	hdr->data_entry_len = key_len + pad_len + sz;
+}
+
+int write_file_header_v2(FILE *fp, struct motif_table_header_v2 *hdr)
+{
+    int ok = fseek(fp, 0, SEEK_SET) == 0 &&
+	fwrite(hdr, sizeof(*hdr), 1, fp) == 1 &&
+	fseek(fp, 0, SEEK_END) == 0;
+    if (!ok)
+	fprintf(stderr, "Error writing table header: %s\n", strerror(errno));
+    return ok;
+}
+
+static uint64_t align64(uint64_t n)
+{
+    return (n + 63) & ~(uint64_t) 63;
+}
+
+/*
+ * Write data over section i, moving the sections after it up or down
+ * so that the old payload does not linger in the file.
+ */
+static int replace_table_section(FILE *fp, struct motif_table_header_v2 *hdr, uint32_t i,
+				 const void *data, size_t size)
+{
+    static const char zero[64] = { 0 };
+    uint64_t off = hdr->sections[i].offset;
+    uint64_t old_end = align64(off + hdr->sections[i].size);
+    uint64_t new_end = align64(off + size);
+    if (fseek(fp, 0, SEEK_END) != 0)
+	return 0;
+    long file_end = ftell(fp);
+    size_t tail_len = file_end > (long) old_end ? file_end - old_end : 0;
+    char *tail = (char *) malloc(tail_len + 1);
+    int ok = tail != 0 && fseek(fp, old_end, SEEK_SET) == 0 &&
+	fread(tail, 1, tail_len, fp) == tail_len;
+
+    size_t pad = tail_len ? new_end - (off + size) : 0;
+    ok = ok && fseek(fp, off, SEEK_SET) == 0 &&
+	fwrite(data, 1, size, fp) == size &&
+	fwrite(zero, 1, pad, fp) == pad &&
+	fwrite(tail, 1, tail_len, fp) == tail_len &&
+	fflush(fp) == 0 &&
+	ftruncate(fileno(fp), off + size + pad + tail_len) == 0;
+    free(tail);
+    if (!ok)
+    {
+	fprintf(stderr, "add_table_section: cannot replace section: %s\n", strerror(errno));
+	return 0;
+    }
+
+    uint32_t j;
+    for (j = 0; j < hdr->nsections; j++)
+	if (hdr->sections[j].offset > off)
+	    hdr->sections[j].offset += new_end - old_end;
+    hdr->sections[i].size = size;
+    return write_file_header_v2(fp, hdr);
+}
+
+int add_table_section(FILE *fp, struct motif_table_header_v2 *hdr, uint32_t type,
+		      const void *data, size_t size)
+{
+    uint32_t i;
+    for (i = 0; i < hdr->nsections; i++)
+	if (hdr->sections[i].type == type)
+	    break;
+    if (i == MOTIF_MAX_SECTIONS)
+    {
+	fprintf(stderr, "add_table_section: table already has %d sections\n", MOTIF_MAX_SECTIONS);
+	return 0;
+    }
+
+    static const char zero[64] = { 0 };
+    if (i < hdr->nsections)
+	return replace_table_section(fp, hdr, i, data, size);
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+	return 0;
+    long pos = ftell(fp);
+    long pad = (64 - pos % 64) % 64;
+    if (pos < 0 || fwrite(zero, 1, pad, fp) != (size_t) pad ||
+	fwrite(data, 1, size, fp) != size)
+    {
+	fprintf(stderr, "add_table_section: write failed: %s\n", strerror(errno));
+	return 0;
+    }
+
+    hdr->sections[i].type = type;
+    hdr->sections[i].offset = pos + pad;
+    hdr->sections[i].size = size;
+    if (i == hdr->nsections)
+	hdr->nsections++;
+    return write_file_header_v2(fp, hdr);
+}
+
+long find_in_range(struct motif_table *tbl, char *motif, unsigned long start, unsigned long len)
 {
+    if (tbl->header.flags & MOTIF_TABLE_PACKED_KEYS)
+    {
+	uint64_t key;
+	if (!encode_motif(motif, tbl->header.motif_len, &key))
+	    return -1;
+	return find_key_in_range(tbl, key, start, len);
+    }
+
+    if (tbl->search == SEARCH_CUCKOO)
+	return cuckoo_find_motif(tbl, motif);
+    if (tbl->search == SEARCH_FRONT_CODED)
+	return frontcode_find(&tbl->fc, (const unsigned char *) motif);
+
+    if (tbl->bloom.nblocks && !bloom_contains(&tbl->bloom, hash_motif(motif, tbl->header.motif_len)))
+	return -1;
+
+    if (tbl->search == SEARCH_MPHF && start == 0 && len == tbl->len)
+    {
+	long n = mphf_lookup(&tbl->mphf, hash_motif(motif, tbl->header.motif_len));
+	if (n >= 0 && strncmp(get_motif_at(tbl, n), motif, tbl->header.motif_len) == 0)
+	    return n;
+	return -1;
+    }
+
+    if (tbl->prefix_start && start == 0 && len == tbl->len)
+    {
+	unsigned long b = motif_bucket(tbl, motif);
+	start = bucket_start(tbl, b);
+	len = bucket_start(tbl, b + 1) - start;
+    }
+
     /*
      * Find the midpoint, iterate.
      */
@@ -152,3 +1607,584 @@ int find_in_range(struct motif_table *tbl, char *motif, unsigned long start, uns
 
     return -1;
 }
+
+long find_key_in_range(struct motif_table *tbl, uint64_t key, unsigned long start, unsigned long len)
+{
+    if (tbl->search == SEARCH_CUCKOO)
+	return cuckoo_find_key(tbl, key);
+    if (tbl->search == SEARCH_FRONT_CODED)
+    {
+	uint64_t be = htobe64(key);
+	return frontcode_find(&tbl->fc, (const unsigned char *) &be);
+    }
+    if (tbl->search == SEARCH_ELIAS_FANO)
+	return ef_find(&tbl->ef, key);
+
+    if (tbl->bloom.nblocks && !bloom_contains(&tbl->bloom, hash_key(key)))
+	return -1;
+
+    if (start == 0 && len == tbl->len)
+    {
+	if (tbl->search == SEARCH_MPHF)
+	{
+	    long n = mphf_lookup(&tbl->mphf, hash_key(key));
+	    return (n >= 0 && get_key_at(tbl, n) == key) ? n : -1;
+	}
+	if (tbl->search == SEARCH_STREE)
+	    return stree_find(&tbl->stree, key);
+	if (tbl->search == SEARCH_EYTZINGER)
+	    return eytzinger_find(&tbl->eytz, key);
+
+	if (tbl->search == SEARCH_PGM)
+	    pgm_range(&tbl->pgm, key, &start, &len);
+	else if (tbl->prefix_start)
+	{
+	    unsigned long b = key_bucket(tbl, key);
+	    start = bucket_start(tbl, b);
+	    len = bucket_start(tbl, b + 1) - start;
+	}
+    }
+
+    unsigned long beg = start;
+    unsigned long end = start + len;
+
+    while (beg < end)
+    {
+	unsigned long mid = (end + beg) / 2;
+	uint64_t tkey = get_key_at(tbl, mid);
+	if (key < tkey)
+	    end = mid;
+	else if (key == tkey)
+	    return mid;
+	else
+	    beg = mid + 1;
+    }
+
+    return -1;
+}
+
+/*
+ * Number of searches find_*_batch keeps in flight.
+ */
+#define BATCH_WIDTH 32
+
+/*
+ * How far ahead of the searches to prefetch Bloom filter blocks.
+ */
+#define BLOOM_AHEAD 16
+
+/*
+ * Narrow [*start, *start + *len) to a bucket if the prefix index allows.
+ */
+static void bucket_range(struct motif_table *tbl, unsigned long b, unsigned long *start, unsigned long *len)
+{
+    if (tbl->prefix_start)
+    {
+	*start = bucket_start(tbl, b);
+	*len = bucket_start(tbl, b + 1) - *start;
+    }
+    else
+    {
+	*start = 0;
+	*len = tbl->len;
+    }
+}
+
+/*
+ * The batch kernels each search for w motifs or keys in lockstep,
+ * storing the entry found for m[q] or x[q] in results[pos[q]].
+ */
+
+static void batch_motifs(struct motif_table *tbl, char **m, int w, const int *pos, long *results)
+{
+    int mlen = tbl->header.motif_len;
+    unsigned long base[BATCH_WIDTH];
+    unsigned long n[BATCH_WIDTH];
+    int q;
+
+    for (q = 0; q < w; q++)
+    {
+	bucket_range(tbl, motif_bucket(tbl, m[q]), &base[q], &n[q]);
+	if (n[q])
+	    __builtin_prefetch(get_motif_at(tbl, base[q] + n[q] / 2));
+    }
+
+    /*
+     * Branch-free lower bound: base[q] ends at the last entry < m[q],
+     * or at the start of the range.
+     */
+    int active = 1;
+    while (active)
+    {
+	active = 0;
+	for (q = 0; q < w; q++)
+	{
+	    if (n[q] <= 1)
+		continue;
+	    unsigned long half = n[q] / 2;
+	    if (strncmp(get_motif_at(tbl, base[q] + half), m[q], mlen) < 0)
+		base[q] += half;
+	    n[q] -= half;
+	    __builtin_prefetch(get_motif_at(tbl, base[q] + n[q] / 2));
+	    active = 1;
+	}
+    }
+
+    for (q = 0; q < w; q++)
+    {
+	results[pos[q]] = -1;
+	if (n[q] == 0)
+	    continue;
+	unsigned long p = base[q];
+	int cmp = strncmp(get_motif_at(tbl, p), m[q], mlen);
+	if (cmp < 0)
+	{
+	    if (++p >= tbl->len)
+		continue;
+	    cmp = strncmp(get_motif_at(tbl, p), m[q], mlen);
+	}
+	if (cmp == 0)
+	    results[pos[q]] = p;
+    }
+}
+
+/*
+ * Binary search for x[q] among [base[q], base[q] + n[q]), the ranges'
+ * midpoints having been prefetched.
+ */
+static void batch_keys_in_ranges(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results,
+				 unsigned long *base, unsigned long *n)
+{
+    int q;
+    int active = 1;
+    while (active)
+    {
+	active = 0;
+	for (q = 0; q < w; q++)
+	{
+	    if (n[q] <= 1)
+		continue;
+	    unsigned long half = n[q] / 2;
+	    if (get_key_at(tbl, base[q] + half) < x[q])
+		base[q] += half;
+	    n[q] -= half;
+	    __builtin_prefetch(get_motif_at(tbl, base[q] + n[q] / 2));
+	    active = 1;
+	}
+    }
+
+    for (q = 0; q < w; q++)
+    {
+	results[pos[q]] = -1;
+	if (n[q] == 0)
+	    continue;
+	unsigned long p = base[q];
+	uint64_t t = get_key_at(tbl, p);
+	if (t < x[q])
+	{
+	    if (++p >= tbl->len)
+		continue;
+	    t = get_key_at(tbl, p);
+	}
+	if (t == x[q])
+	    results[pos[q]] = p;
+    }
+}
+
+static void batch_keys_binary(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    unsigned long base[BATCH_WIDTH];
+    unsigned long n[BATCH_WIDTH];
+    int q;
+
+    for (q = 0; q < w; q++)
+    {
+	bucket_range(tbl, key_bucket(tbl, x[q]), &base[q], &n[q]);
+	if (n[q])
+	    __builtin_prefetch(get_motif_at(tbl, base[q] + n[q] / 2));
+    }
+    batch_keys_in_ranges(tbl, x, w, pos, results, base, n);
+}
+
+/*
+ * Walk the learned index down a level at a time for the whole group,
+ * prefetching each key's window on the level below, then search the
+ * predicted windows of the table.
+ */
+static void batch_keys_pgm(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    const struct pgm_index *idx = &tbl->pgm;
+    uint64_t s[BATCH_WIDTH];
+    uint64_t lo[BATCH_WIDTH];
+    uint64_t hi[BATCH_WIDTH];
+    unsigned long base[BATCH_WIDTH];
+    unsigned long n[BATCH_WIDTH];
+    int q, l;
+
+    if (idx->count == 0)
+    {
+	for (q = 0; q < w; q++)
+	    results[pos[q]] = -1;
+	return;
+    }
+
+    for (q = 0; q < w; q++)
+	s[q] = 0;
+    for (l = idx->nlevels - 1; l > 0; l--)
+    {
+	for (q = 0; q < w; q++)
+	{
+	    pgm_window(idx, l, s[q], x[q], &lo[q], &hi[q]);
+	    __builtin_prefetch(idx->levels[l - 1] + (lo[q] + hi[q]) / 2);
+	}
+	for (q = 0; q < w; q++)
+	    s[q] = pgm_segment(idx, l - 1, lo[q], hi[q], x[q]);
+    }
+    for (q = 0; q < w; q++)
+    {
+	pgm_window(idx, 0, s[q], x[q], &lo[q], &hi[q]);
+	base[q] = lo[q];
+	n[q] = hi[q] - lo[q];
+	if (n[q])
+	    __builtin_prefetch(get_motif_at(tbl, base[q] + n[q] / 2));
+    }
+    batch_keys_in_ranges(tbl, x, w, pos, results, base, n);
+}
+
+static void batch_keys_eytzinger(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    const uint64_t *ekeys = tbl->eytz.keys;
+    uint64_t en = tbl->eytz.count;
+    uint64_t k[BATCH_WIDTH];
+    int q;
+
+    for (q = 0; q < w; q++)
+	k[q] = 1;
+
+    /*
+     * Every search descends the same number of levels, give or take one.
+     */
+    int active = 1;
+    while (active)
+    {
+	active = 0;
+	for (q = 0; q < w; q++)
+	{
+	    if (k[q] > en)
+		continue;
+	    __builtin_prefetch(ekeys + 8 * k[q]);
+	    k[q] = 2 * k[q] + (ekeys[k[q]] < x[q]);
+	    active = 1;
+	}
+    }
+
+    for (q = 0; q < w; q++)
+    {
+	uint64_t kk = k[q] >> __builtin_ffsll(~k[q]);
+	results[pos[q]] = (kk != 0 && ekeys[kk] == x[q]) ? (long) tbl->eytz.entries[kk] : -1;
+    }
+}
+
+static void batch_keys_stree(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    const struct stree_index *st = &tbl->stree;
+    uint64_t k[BATCH_WIDTH];
+    uint64_t found[BATCH_WIDTH];
+    int q;
+
+    for (q = 0; q < w; q++)
+    {
+	k[q] = 0;
+	found[q] = UINT64_MAX;
+    }
+
+    int active = 1;
+    while (active)
+    {
+	active = 0;
+	for (q = 0; q < w; q++)
+	{
+	    if (k[q] >= st->nblocks)
+		continue;
+	    int r = stree_rank(st, k[q], x[q]);
+	    if (r < STREE_B)
+		found[q] = k[q] * STREE_B + r;
+	    k[q] = stree_child(k[q], r);
+	    if (k[q] < st->nblocks)
+	    {
+		const uint64_t *node = st->keys + k[q] * STREE_B;
+		__builtin_prefetch(node);
+		__builtin_prefetch(node + 8);
+	    }
+	    active = 1;
+	}
+    }
+
+    for (q = 0; q < w; q++)
+    {
+	uint64_t f = found[q];
+	results[pos[q]] = (f != UINT64_MAX && st->keys[f] == x[q]) ? (long) st->entries[f] : -1;
+    }
+}
+
+/*
+ * Perfect hash lookups are independent, so rather than lockstep we
+ * run each stage for the whole group, prefetching what the next stage
+ * of each lookup will touch.
+ */
+static void batch_keys_mphf(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    uint64_t h[BATCH_WIDTH];
+    long n[BATCH_WIDTH];
+    int q;
+
+    for (q = 0; q < w; q++)
+    {
+	h[q] = hash_key(x[q]);
+	__builtin_prefetch(mphf_first_probe(&tbl->mphf, h[q]));
+    }
+    for (q = 0; q < w; q++)
+    {
+	n[q] = mphf_lookup(&tbl->mphf, h[q]);
+	if (n[q] >= 0)
+	    __builtin_prefetch(get_motif_at(tbl, n[q]));
+    }
+    for (q = 0; q < w; q++)
+	results[pos[q]] = (n[q] >= 0 && get_key_at(tbl, n[q]) == x[q]) ? n[q] : -1;
+}
+
+static void batch_motifs_mphf(struct motif_table *tbl, char **m, int w, const int *pos, long *results)
+{
+    int mlen = tbl->header.motif_len;
+    uint64_t h[BATCH_WIDTH];
+    long n[BATCH_WIDTH];
+    int q;
+
+    for (q = 0; q < w; q++)
+    {
+	h[q] = hash_motif(m[q], mlen);
+	__builtin_prefetch(mphf_first_probe(&tbl->mphf, h[q]));
+    }
+    for (q = 0; q < w; q++)
+    {
+	n[q] = mphf_lookup(&tbl->mphf, h[q]);
+	if (n[q] >= 0)
+	    __builtin_prefetch(get_motif_at(tbl, n[q]));
+    }
+    for (q = 0; q < w; q++)
+	results[pos[q]] = (n[q] >= 0 && strncmp(get_motif_at(tbl, n[q]), m[q], mlen) == 0) ? n[q] : -1;
+}
+
+/*
+ * Cuckoo lookups likewise: prefetch both buckets of every key, then
+ * compare. A bucket may straddle two cache lines, so fetch its last
+ * byte too.
+ */
+static void prefetch_bucket(struct motif_table *tbl, uint64_t b)
+{
+    const char *p = get_motif_at(tbl, b * CUCKOO_SLOTS);
+    __builtin_prefetch(p);
+    __builtin_prefetch(p + CUCKOO_SLOTS * tbl->header.data_entry_len - 1);
+}
+
+static void batch_keys_cuckoo(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    uint64_t nbuckets = tbl->len / CUCKOO_SLOTS;
+    uint64_t b[BATCH_WIDTH][2];
+    int q, i, s;
+
+    if (nbuckets == 0)
+    {
+	for (q = 0; q < w; q++)
+	    results[pos[q]] = -1;
+	return;
+    }
+    for (q = 0; q < w; q++)
+    {
+	cuckoo_buckets(hash_key(x[q]), nbuckets, b[q]);
+	prefetch_bucket(tbl, b[q][0]);
+	prefetch_bucket(tbl, b[q][1]);
+    }
+    for (q = 0; q < w; q++)
+    {
+	results[pos[q]] = -1;
+	for (i = 0; i < 2 && results[pos[q]] < 0; i++)
+	    for (s = 0; s < CUCKOO_SLOTS; s++)
+		if (get_key_at(tbl, b[q][i] * CUCKOO_SLOTS + s) == x[q])
+		{
+		    results[pos[q]] = b[q][i] * CUCKOO_SLOTS + s;
+		    break;
+		}
+    }
+}
+
+static void batch_motifs_cuckoo(struct motif_table *tbl, char **m, int w, const int *pos, long *results)
+{
+    uint64_t nbuckets = tbl->len / CUCKOO_SLOTS;
+    int q;
+
+    if (nbuckets == 0)
+    {
+	for (q = 0; q < w; q++)
+	    results[pos[q]] = -1;
+	return;
+    }
+    for (q = 0; q < w; q++)
+    {
+	uint64_t b[2];
+	cuckoo_buckets(hash_motif(m[q], tbl->header.motif_len), nbuckets, b);
+	prefetch_bucket(tbl, b[0]);
+	prefetch_bucket(tbl, b[1]);
+    }
+    for (q = 0; q < w; q++)
+	results[pos[q]] = cuckoo_find_motif(tbl, m[q]);
+}
+
+/*
+ * Decoding a block is sequential, so the lookups are just made one
+ * after another.
+ */
+static void batch_keys_front_coded(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    int q;
+    for (q = 0; q < w; q++)
+    {
+	uint64_t be = htobe64(x[q]);
+	results[pos[q]] = frontcode_find(&tbl->fc, (const unsigned char *) &be);
+    }
+}
+
+/*
+ * Prefetch each key's zero sample, then look the keys up.
+ */
+static void batch_keys_elias_fano(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    const struct ef_index *ef = &tbl->ef;
+    int q;
+    for (q = 0; q < w; q++)
+    {
+	uint64_t h = x[q] >> ef->low_bits;
+	if (h && h < ef->nruns)
+	    __builtin_prefetch(&ef->samples[(h - 1) / EF_SAMPLE]);
+    }
+    for (q = 0; q < w; q++)
+	results[pos[q]] = ef_find(ef, x[q]);
+}
+
+static void batch_motif_group(struct motif_table *tbl, char **m, int w, const int *pos, long *results)
+{
+    int q;
+    if (tbl->search == SEARCH_CUCKOO)
+	batch_motifs_cuckoo(tbl, m, w, pos, results);
+    else if (tbl->search == SEARCH_FRONT_CODED)
+	for (q = 0; q < w; q++)
+	    results[pos[q]] = frontcode_find(&tbl->fc, (const unsigned char *) m[q]);
+    else if (tbl->search == SEARCH_MPHF)
+	batch_motifs_mphf(tbl, m, w, pos, results);
+    else
+	batch_motifs(tbl, m, w, pos, results);
+}
+
+static void batch_keys(struct motif_table *tbl, const uint64_t *x, int w, const int *pos, long *results)
+{
+    switch (tbl->search)
+    {
+    case SEARCH_CUCKOO:
+	batch_keys_cuckoo(tbl, x, w, pos, results);
+	break;
+    case SEARCH_MPHF:
+	batch_keys_mphf(tbl, x, w, pos, results);
+	break;
+    case SEARCH_STREE:
+	batch_keys_stree(tbl, x, w, pos, results);
+	break;
+    case SEARCH_EYTZINGER:
+	batch_keys_eytzinger(tbl, x, w, pos, results);
+	break;
+    case SEARCH_PGM:
+	batch_keys_pgm(tbl, x, w, pos, results);
+	break;
+    case SEARCH_FRONT_CODED:
+	batch_keys_front_coded(tbl, x, w, pos, results);
+	break;
+    case SEARCH_ELIAS_FANO:
+	batch_keys_elias_fano(tbl, x, w, pos, results);
+	break;
+    default:
+	batch_keys_binary(tbl, x, w, pos, results);
+	break;
+    }
+}
+
+void find_motifs_batch(struct motif_table *tbl, char **motifs, int count, long *results)
+{
+    if (tbl->header.flags & MOTIF_TABLE_PACKED_KEYS)
+    {
+	uint64_t keys[BATCH_WIDTH];
+	int i, j;
+	for (i = 0; i < count; i += BATCH_WIDTH)
+	{
+	    int w = count - i < BATCH_WIDTH ? count - i : BATCH_WIDTH;
+	    for (j = 0; j < w; j++)
+		if (!encode_motif(motifs[i + j], tbl->header.motif_len, &keys[j]))
+		    keys[j] = 0;
+	    find_keys_batch(tbl, keys, w, results + i);
+	}
+	return;
+    }
+
+    int mlen = tbl->header.motif_len;
+    char *m[BATCH_WIDTH];
+    int pos[BATCH_WIDTH];
+    int w = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+	results[i] = -1;
+	if (tbl->bloom.nblocks &&
+	    !bloom_contains(&tbl->bloom, hash_motif(motifs[i], mlen)))
+	    continue;
+	m[w] = motifs[i];
+	pos[w] = i;
+	if (++w == BATCH_WIDTH)
+	{
+	    batch_motif_group(tbl, m, w, pos, results);
+	    w = 0;
+	}
+    }
+    if (w)
+	batch_motif_group(tbl, m, w, pos, results);
+}
+
+void find_keys_batch(struct motif_table *tbl, const uint64_t *keys, int count, long *results)
+{
+    const struct bloom_filter *bf = tbl->bloom.nblocks ? &tbl->bloom : 0;
+    uint64_t x[BATCH_WIDTH];
+    int pos[BATCH_WIDTH];
+    int w = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+	results[i] = -1;
+	if (keys[i] == 0)
+	    continue;
+	if (bf)
+	{
+	    if (i + BLOOM_AHEAD < count)
+		__builtin_prefetch(bloom_block(bf, hash_key(keys[i + BLOOM_AHEAD])));
+	    if (!bloom_contains(bf, hash_key(keys[i])))
+		continue;
+	}
+	x[w] = keys[i];
+	pos[w] = i;
+	if (++w == BATCH_WIDTH)
+	{
+	    batch_keys(tbl, x, w, pos, results);
+	    w = 0;
+	}
+    }
+    if (w)
+	batch_keys(tbl, x, w, pos, results);
+}
@@ -6,11 +6,106 @@ extern "C" {
 #endif 
 
 #include <stdio.h>
+#include <stdint.h>
+#include <endian.h>
+#include <string.h>
+
+#include "eytzinger.h"
+#include "stree.h"
+#include "bloom.h"
+#include "mphf.h"
+#include "cuckoo.h"
+#include "pgm.h"
+#include "bitpack.h"
+#include "frontcode.h"
+#include "eliasfano.h"
 
 /*
  * Table of motif => score data.
  */
 
+#define MOTIF_MAX_ATTRS 31	/* attributes per table */
+
+/*
+ * Bits in motif_table_header.flags.
+ *
+ * MOTIF_TABLE_PACKED_KEYS: each entry starts with a big-endian packed
+ * uint64_t key (see motif_key.h) instead of motif_len raw characters.
+ */
+#define MOTIF_TABLE_PACKED_KEYS	0x1
+
+/*
+ * MOTIF_TABLE_CUCKOO: entries are stored in a cuckoo hash table (see
+ * cuckoo.h) rather than sorted, starting on the first cache line
+ * boundary after the header.
+ */
+#define MOTIF_TABLE_CUCKOO	0x2
+
+/*
+ * MOTIF_TABLE_COLUMNAR: version 2 only. The entries section holds just
+ * the keys, data_entry_len apart, and attribute i is a separate column
+ * of attr_len[i]-byte values in section MOTIF_SECTION_ATTRS + i, indexed
+ * by entry number. Searches then only touch key bytes.
+ */
+#define MOTIF_TABLE_COLUMNAR	0x4
+
+/*
+ * MOTIF_TABLE_BITPACKED: with MOTIF_TABLE_COLUMNAR, each attribute
+ * column is bit-packed against its minimum (see bitpack.h). attr_len
+ * still gives the attribute's declared width, which decides how its
+ * values read back.
+ */
+#define MOTIF_TABLE_BITPACKED	0x8
+
+/*
+ * MOTIF_TABLE_DICTIONARY: version 2 only. The entries section holds just
+ * the keys, as for MOTIF_TABLE_COLUMNAR, and each entry's attributes
+ * are one of the distinct tuples in section MOTIF_SECTION_TUPLES
+ * (num_attrs int32_t values each), numbered by section
+ * MOTIF_SECTION_TUPLE_IDS (a bit-packed column, see bitpack.h). Values
+ * are as they read back at their attr_len.
+ */
+#define MOTIF_TABLE_DICTIONARY	0x10
+
+/*
+ * MOTIF_TABLE_FRONT_CODED: version 2 only. The keys are front coded in
+ * blocks (see frontcode.h) in section MOTIF_SECTION_FRONT_CODED instead
+ * of an entries section, with packed keys in big-endian order. The
+ * attributes are columnar or dictionary encoded. Only exact lookups
+ * are supported, so the search indexes do not apply.
+ */
+#define MOTIF_TABLE_FRONT_CODED	0x20
+
+/*
+ * MOTIF_TABLE_ELIAS_FANO: as MOTIF_TABLE_FRONT_CODED, but the packed
+ * keys are Elias-Fano encoded (see eliasfano.h) in section
+ * MOTIF_SECTION_ELIAS_FANO.
+ */
+#define MOTIF_TABLE_ELIAS_FANO	0x40
+
+/*
+ * MOTIF_TABLE_DELTA: version 2 only. The table holds changes to a base
+ * table: its entries replace the base's entries for the same motifs,
+ * and those marked in section MOTIF_SECTION_TOMBSTONES (a bitmap of
+ * uint64_t words, entry n being bit n % 64 of word n / 64) delete them.
+ * Delta tables are sorted and do not have encoded keys.
+ */
+#define MOTIF_TABLE_DELTA	0x80
+
+/*
+ * MOTIF_TABLE_LARGE: version 2 only. The table has more than INT32_MAX
+ * entries, so entry numbers need 64 bits; readers that keep them in an
+ * int must not use it. The eytzinger, s-tree and perfect hash indexes
+ * and the prefix index hold 32-bit entry numbers, and are neither built
+ * nor loaded for these tables (see is_large_table).
+ */
+#define MOTIF_TABLE_LARGE	0x100
+
+/*
+ * Tables whose keys are only reachable through their own encoding.
+ */
+#define MOTIF_TABLE_ENCODED_KEYS (MOTIF_TABLE_FRONT_CODED | MOTIF_TABLE_ELIAS_FANO)
+
 /*
  * This is the header that is at the beginning of the file storing
  * a motif table. Try to make it a multiple of 4 bytes in size so that
@@ -18,6 +113,9 @@ extern "C" {
  *
  * pad_len is nonzero if extra padding is required to round the
  * size of each entry to a convenient alignment.
+ *
+ * flags occupies what used to be attr_len[31], which older writers
+ * always left zero.
  */
     
 struct motif_table_header
@@ -26,33 +124,333 @@ struct motif_table_header
     int motif_len;
     int pad_len;
     int num_attrs;
-    int attr_len[32];
-    int data_entry_len;		/*  This should be motif_len + pad_len + sum of attr lens */
+    int attr_len[MOTIF_MAX_ATTRS];
+    int flags;
+    int data_entry_len;		/*  This should be key_len + pad_len + sum of attr lens */
+};
+
+/*
+ * Version 2 table files start with MOTIF_TABLE_V2_SIGNATURE instead of
+ * a version 1 header. All values in a version 2 file, including packed
+ * keys and attributes, are native (little-endian) rather than network
+ * order.
+ *
+ * The header is followed by sections, each starting on a 64-byte
+ * boundary and listed in the header's section directory. A section's
+ * type is MOTIF_SECTION_ENTRIES for the table entries themselves, or
+ * the magic number of the index or filter it holds (EYTZINGER_MAGIC,
+ * ...), laid out as the index would be in a sidecar file after the
+ * sidecar header. Indexes in sections take precedence over sidecars.
+ */
+#define MOTIF_TABLE_V2_SIGNATURE "MOTIFTB2"
+#define MOTIF_MAX_SECTIONS 48
+
+#define MOTIF_SECTION_ENTRIES 0x454e5452	/* "ENTR" */
+#define MOTIF_SECTION_ATTRS 0x41545200		/* "ATR" + attribute number */
+#define MOTIF_SECTION_TUPLES 0x5455504c		/* "TUPL" */
+#define MOTIF_SECTION_TUPLE_IDS 0x54494453	/* "TIDS" */
+#define MOTIF_SECTION_FRONT_CODED 0x46434f44	/* "FCOD" */
+#define MOTIF_SECTION_ELIAS_FANO 0x45464b59	/* "EFKY" */
+#define MOTIF_SECTION_TOMBSTONES 0x544f4d42	/* "TOMB" */
+
+struct motif_section
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct motif_table_header_v2
+{
+    char signature[8];
+    uint32_t version;
+    uint32_t nsections;
+    int32_t magic;
+    int32_t motif_len;
+    int32_t pad_len;
+    int32_t num_attrs;
+    int32_t flags;
+    int32_t data_entry_len;
+    uint64_t count;		/* number of entries */
+    int32_t attr_len[MOTIF_MAX_ATTRS + 1];
+    struct motif_section sections[MOTIF_MAX_SECTIONS];
+    uint64_t reserved[2];
+};
+
+/*
+ * Search methods for whole-table lookups. SEARCH_EYTZINGER,
+ * SEARCH_STREE and SEARCH_PGM need packed keys. SEARCH_AUTO picks the best index the
+ * table has. Cuckoo tables can only use SEARCH_CUCKOO, front-coded
+ * tables SEARCH_FRONT_CODED and Elias-Fano tables SEARCH_ELIAS_FANO.
+ */
+enum search_method
+{
+    SEARCH_AUTO,
+    SEARCH_BINARY,
+    SEARCH_EYTZINGER,
+    SEARCH_STREE,
+    SEARCH_MPHF,
+    SEARCH_CUCKOO,
+    SEARCH_PGM,
+    SEARCH_FRONT_CODED,
+    SEARCH_ELIAS_FANO
+};
+
+/*
+ * Header at the start of an index sidecar file, which lives next to
+ * the table as the table's file name plus a suffix (".eytz", ...).
+ * table_size and table_mtime identify the table the index was built
+ * from; a sidecar that does not match its table is ignored. The index
+ * itself starts 64 bytes in.
+ */
+struct sidecar_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t table_size;
+    int64_t table_mtime;
+    uint64_t reserved[5];
+};
+
+/*
+ * Residency options for mapping a table (and its sidecars), trading
+ * start-up time and memory for fewer page faults on early lookups.
+ * 0 maps lazily, faulting pages in as lookups touch them.
+ *
+ * MOTIF_MAP_POPULATE: read the whole file in while mapping it.
+ * MOTIF_MAP_WILLNEED: start reading it in the background. Only the
+ *	madvise call counts towards warmup_seconds, not the reads.
+ * MOTIF_MAP_RANDOM: turn off read-ahead, for tables larger than memory.
+ * MOTIF_MAP_LOCK: lock it in memory (subject to RLIMIT_MEMLOCK).
+ * MOTIF_MAP_HUGE: copy it into anonymous memory backed by huge pages,
+ *	so that random probes of a large table need fewer TLB entries.
+ *	Explicit huge pages (MAP_HUGETLB) are tried first, then
+ *	transparent huge pages (MADV_HUGEPAGE); failing both, the copy
+ *	has ordinary pages.
+ * MOTIF_MAP_NUMA: also copy a version 2 table into anonymous memory on
+ *	each NUMA node, as replicas, so that lookups can read the copy
+ *	local to the calling thread's node (see numa_node).
+ */
+#define MOTIF_MAP_POPULATE	0x1
+#define MOTIF_MAP_WILLNEED	0x2
+#define MOTIF_MAP_RANDOM	0x4
+#define MOTIF_MAP_LOCK		0x8
+#define MOTIF_MAP_HUGE		0x10
+#define MOTIF_MAP_NUMA		0x20
+
+struct table_sidecar
+{
+    int map_opts;
+    void *address;
+    size_t size;
 };
 
 struct motif_table
 {
-    struct motif_table_header header;
+    struct motif_table_header header;	/* in host order, for either version */
+    int version;
+    const struct motif_section *sections;	/* version 2 only */
+    int nsections;
     char *table;
     unsigned long len; 
+    int key_len;		/* motif_len, or sizeof(uint64_t) for packed keys */
+
+    /*
+     * Read the packed key at entry, in the byte order of the table's
+     * format version; chosen when the table is mapped.
+     */
+    uint64_t (*key_at)(const char *entry);
+
+    /*
+     * Where attribute i of entry n is, other than in a dictionary-encoded
+     * table: packed_attr[i] in a bit-packed table, attr_column[i] +
+     * n * attr_len[i] in another columnar table, otherwise
+     * attr_offset[i] into entry n's row.
+     */
+    const char *attr_column[MOTIF_MAX_ATTRS];
+    int attr_offset[MOTIF_MAX_ATTRS];
+    struct bitpack_column packed_attr[MOTIF_MAX_ATTRS];	/* bit-packed tables */
+
+    /*
+     * Dictionary-encoded tables: entry n's attributes are
+     * tuples + num_attrs * tuple_ids[n].
+     */
+    const int32_t *tuples;
+    uint64_t ntuples;
+    struct bitpack_column tuple_ids;
+
+    /*
+     * Delta tables: the bitmap of entries that delete a base entry.
+     */
+    const uint64_t *tombstones;
     char mapped_file[1024];
     int mapped_fd;
     void *mapped_address;
     size_t mapped_size;
+    int64_t mapped_mtime;	/* nanoseconds */
+    int map_opts;		/* MOTIF_MAP_* */
+    double warmup_seconds;	/* spent applying map_opts */
+    size_t page_size;		/* of the memory holding the table */
+
+    /*
+     * Optional search indexes, loaded from sections or sidecars by
+     * map_table.
+     */
+    struct table_sidecar eytz_map;
+    struct eytzinger_index eytz;
+    struct table_sidecar stree_map;
+    struct stree_index stree;
+
+    /*
+     * Optional Bloom filter, checked before any search.
+     */
+    struct table_sidecar bloom_map;
+    struct bloom_filter bloom;
+
+    /*
+     * Optional minimal perfect hash for exact lookups.
+     */
+    struct table_sidecar mphf_map;
+    struct mphf_index mphf;
+
+    /*
+     * Optional learned index, narrowing a search to a small window.
+     */
+    struct table_sidecar pgm_map;
+    struct pgm_index pgm;
+
+    /*
+     * Keys of a front-coded or Elias-Fano table, whose table is then 0.
+     */
+    struct frontcode_index fc;
+    struct ef_index ef;
+
+    int search_method;		/* as requested */
+    int search;			/* as resolved against the loaded indexes */
+
+    /*
+     * Prefix bucket index: prefix_start[b] is the first entry whose
+     * leading residues (3 for packed keys, 2 bytes otherwise) form a
+     * value >= b. Filled in lazily as buckets are first probed.
+     */
+    uint32_t *prefix_start;
+    unsigned long prefix_buckets;
+    int prefix_len;
+
+    struct shared_table *shared;	/* set by acquire_table */
+
+    /*
+     * MOTIF_MAP_NUMA: replicas[node] is a copy of the table in memory
+     * on that node, or 0 for nodes that are offline or out of memory.
+     */
+    struct motif_table **replicas;
+    int nreplicas;
 };
 
+/*
+ * Offset in the file of the first entry of a table with the given flags.
+ */
+inline size_t table_data_offset(int flags)
+{
+    if (flags & MOTIF_TABLE_CUCKOO)
+	return (sizeof(struct motif_table_header) + 63) & ~(size_t) 63;
+    return sizeof(struct motif_table_header);
+}
+
 inline char *get_motif_at(struct motif_table *tbl, unsigned long n)
 {
     return (tbl->table + n * tbl->header.data_entry_len);
 }
 
-int write_file_header(FILE *fp, int magic, int motif_len, int pad_len, int attr_len[32], int num_attrs);
+inline uint64_t get_key_at(struct motif_table *tbl, unsigned long n)
+{
+    return tbl->key_at(get_motif_at(tbl, n));
+}
+
+/*
+ * Value of attribute i of entry n, whatever the table's layout.
+ */
+int get_attr_value(struct motif_table *tbl, unsigned long n, int i);
+
+/*
+ * Whether entry n of a delta table deletes its motif from the base.
+ */
+inline int is_tombstone(const struct motif_table *tbl, unsigned long n)
+{
+    return tbl->tombstones && ((tbl->tombstones[n / 64] >> (n % 64)) & 1);
+}
+
+/*
+ * Whether the table is too large for the eytzinger, s-tree and perfect
+ * hash indexes and the prefix index, which hold 32-bit entry numbers:
+ * it is marked MOTIF_TABLE_LARGE, or (version 1) has as many entries.
+ */
+inline int is_large_table(const struct motif_table *tbl)
+{
+    return (tbl->header.flags & MOTIF_TABLE_LARGE) || tbl->len > INT32_MAX;
+}
+
+int write_file_header(FILE *fp, int magic, int motif_len, int pad_len, int attr_len[MOTIF_MAX_ATTRS], int num_attrs, int flags);
+
+/*
+ * Fill in a version 2 header with no sections.
+ */
+void init_file_header_v2(struct motif_table_header_v2 *hdr, int magic, int motif_len, int pad_len,
+			 int attr_len[MOTIF_MAX_ATTRS], int num_attrs, int flags);
+
+/*
+ * Write hdr at the start of fp, leaving fp positioned at the end.
+ */
+int write_file_header_v2(FILE *fp, struct motif_table_header_v2 *hdr);
+
+/*
+ * Append a section to the version 2 table open as fp, and rewrite the
+ * header to list it. A section of the same type replaces the old one,
+ * in place: the sections after it are moved to close up or make room,
+ * so fp must be open for reading as well. As the file is rewritten and
+ * may shrink, fp must not be a file that anyone has mapped; build_index
+ * works on a copy that it renames over the table. Returns 0 on error.
+ */
+int add_table_section(FILE *fp, struct motif_table_header_v2 *hdr, uint32_t type,
+		      const void *data, size_t size);
+
+/*
+ * Find a section of a mapped version 2 table. Returns 0 if there is none.
+ */
+int find_table_section(struct motif_table *tbl, uint32_t type, const void **data, size_t *size);
 
 /*
  * Find the given motif in the range.
  * Return the first item equal to or greater than the search item.
+ *
+ * A search of the whole table (start = 0, len = tbl->len) is first
+ * narrowed to the entries sharing the motif's prefix bucket. If the
+ * table has a Bloom filter, motifs it rejects are not searched at all.
+ * Cuckoo tables have no order to narrow, so start and len are ignored
+ * and the motif's buckets are searched.
+ */
+long find_in_range(struct motif_table *tbl, char *motif, unsigned long start, unsigned long len);
+
+/*
+ * As find_in_range, for a table with packed keys.
+ */
+long find_key_in_range(struct motif_table *tbl, uint64_t key, unsigned long start, unsigned long len);
+
+/*
+ * Hash of entry n's key, as used by the hashed indexes (see hash.h).
+ */
+uint64_t entry_hash(struct motif_table *tbl, unsigned long n);
+
+/*
+ * Look up count motifs (or packed keys) at once, storing each one's
+ * entry number, or -1, in results. The searches advance in lockstep,
+ * prefetching each one's next probe, so that their cache misses
+ * overlap instead of being taken one after another. A zero key is
+ * never found.
  */
-int find_in_range(struct motif_table *tbl, char *motif, unsigned long start, unsigned long len);
+void find_motifs_batch(struct motif_table *tbl, char **motifs, int count, long *results);
+void find_keys_batch(struct motif_table *tbl, const uint64_t *keys, int count, long *results);
 
 /*
  * Compare two motifs. Return -1 if motif1<motif2, 0 if motif1 == motif2, 1 if motif1 > motif2.
@@ -60,8 +458,105 @@ int find_in_range(struct motif_table *tbl, char *motif, unsigned long start, uns
 int compare_motifs(char *motif1, char *motif2);
 
 int map_table(char *file, struct motif_table *table);
+
+/*
+ * As map_table, applying the MOTIF_MAP_* residency options opts to the
+ * table and its sidecars. The time this took is kept in warmup_seconds.
+ */
+int map_table_opts(char *file, struct motif_table *table, int opts);
+
+/*
+ * As map_table_opts, mapping the file already open on fd, which the
+ * table takes over; on error fd is closed. file names the table.
+ */
+int map_table_fd(int fd, char *file, struct motif_table *table, int opts);
+
+/*
+ * Parse a comma-separated list of residency options ("lazy",
+ * "populate", "willneed", "random", "mlock", "hugepages", "numa")
+ * into *opts. Returns 0 if one is unknown.
+ */
+int parse_map_opts(const char *spec, int *opts);
+
+/*
+ * Map size bytes of fd read-only with the residency options *opts,
+ * adding the time taken to *seconds and setting *page_size, if not 0,
+ * to the size of the pages that back the mapping. If the file cannot
+ * be copied into huge pages, it is mapped as usual and MOTIF_MAP_HUGE
+ * is cleared from *opts. Returns MAP_FAILED on error. The mapping must
+ * be released with unmap_resident, given the updated *opts.
+ */
+void *map_resident(int fd, size_t size, int *opts, const char *name, double *seconds,
+		   size_t *page_size);
+void unmap_resident(void *address, size_t size, int opts);
+
+/*
+ * The NUMA node of the CPU the calling thread is running on, from
+ * sched_getcpu and a CPU to node table read from sysfs once.
+ */
+int numa_node();
+
+/*
+ * Set up a version 2 table from an image of its file at address, as
+ * mapped by the caller, which keeps the mapping. name is only for
+ * messages. Sidecar indexes are not looked for.
+ */
+int map_table_image(struct motif_table *table, const char *name, void *address, size_t size);
+
+/*
+ * Unmap a table, or release a table from acquire_table.
+ */
 void unmap_table(struct motif_table *table);
 
+/*
+ * As map_table_opts, but through a process-wide registry of mapped
+ * tables keyed by the device and inode of the file as opened, its modification time
+ * and opts. If the file is already mapped, *table becomes a view of
+ * the existing mapping and its indexes, sharing them rather than
+ * mapping the file again; otherwise it is mapped and registered. Each
+ * view has its own search method. unmap_table releases a view, and the
+ * mapping is unmapped when its last view is released. A file replaced
+ * by renaming a new one over it gets a new mapping. The registry is not
+ * locked while a file is mapped, so other tables can be acquired in the
+ * meantime; callers acquiring the same file wait for that mapping, and
+ * fail with it.
+ */
+int acquire_table(char *file, struct motif_table *table, int opts);
+
+/*
+ * The number of views sharing table's mapping, or 0 if it was not
+ * opened by acquire_table.
+ */
+int table_share_count(struct motif_table *table);
+
+/*
+ * Choose the search method for the table. Returns 0 if the table does
+ * not have the index the method needs.
+ */
+int set_search_method(struct motif_table *tbl, int method);
+
+/*
+ * Name of a search method, or 0 past the last one.
+ */
+const char *search_method_name(int method);
+
+/*
+ * Write an index for tbl to its sidecar file, through a temporary file
+ * renamed over it so that readers mapping the old one are unaffected.
+ * Returns 0 on error.
+ */
+int write_sidecar(struct motif_table *tbl, const char *suffix, uint32_t magic,
+		  const void *data, size_t size);
+
+/*
+ * Map the sidecar with the given suffix, if one exists and was built
+ * from this table. On success sets *data and *size to the index
+ * following the sidecar header and returns 1.
+ */
+int map_sidecar(struct motif_table *tbl, const char *suffix, uint32_t magic,
+		struct table_sidecar *sc, const void **data, size_t *size);
+void unmap_sidecar(struct table_sidecar *sc);
+
 #ifdef __cplusplus
 }
 #endif    